@@ -0,0 +1,94 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Stackful coroutines on top of ucontext. Deprecated by POSIX
+// but still available in every Unix-like system we care about
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "coroutine.h"
+
+struct coroutine{
+    ucontext_t context;
+    ucontext_t caller;
+    void (*fn)(void *);
+    void *arg;
+    void *stack;
+};
+
+// Coroutine being executed, NULL when
+// running in the main (thread) context
+static coroutine *current = NULL;
+
+
+
+// Entry point of every coroutine. makecontext() can only
+// pass ints, so the coroutine is taken from current.
+// Coroutines must never return
+static void trampoline(void){
+    current->fn(current->arg);
+    fprintf(stderr, "Error: coroutine returned\n");
+    exit(EXIT_FAILURE);
+}
+
+
+
+coroutine *coroutine_create(void (*fn)(void *), void *arg, size_t stack_size){
+    coroutine *co = malloc(sizeof(coroutine));
+    void *stack = malloc(stack_size);
+    if ((co == NULL) || (stack == NULL)){
+        fprintf(stderr, "Error: can't allocate coroutine\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    co->fn = fn;
+    co->arg = arg;
+    co->stack = stack;
+    getcontext(&co->context);
+    co->context.uc_stack.ss_sp = stack;
+    co->context.uc_stack.ss_size = stack_size;
+    co->context.uc_link = NULL;
+    makecontext(&co->context, trampoline, 0);
+    return co;
+}
+
+
+
+// Runs a coroutine until it yields
+void coroutine_resume(coroutine *co){
+    coroutine *previous = current;
+    current = co;
+    swapcontext(&co->caller, &co->context);
+    current = previous;
+}
+
+
+
+// Returns from the running coroutine to whoever resumed it.
+// Next resume continues right after this call
+void coroutine_yield(void){
+    coroutine *co = current;
+    swapcontext(&co->context, &co->caller);
+}
+
+
+
+coroutine *coroutine_current(void){
+    return current;
+}
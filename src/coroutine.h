@@ -0,0 +1,29 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef coroutine_h
+    #define coroutine_h
+    #include <stddef.h>
+
+    #define COROUTINE_STACK_SIZE 65536
+
+    typedef struct coroutine coroutine;
+
+    coroutine *coroutine_create(void (*fn)(void *), void *arg, size_t stack_size);
+    void coroutine_resume(coroutine *co);
+    void coroutine_yield(void);
+    coroutine *coroutine_current(void);
+#endif
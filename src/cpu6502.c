@@ -16,9 +16,15 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "cpu6502.h"
+#include "hangdetect.h"
 #include "motherboard.h"
+#include "options.h"
+#include "probes.h"
+#include "profile.h"
+#include "symbols.h"
 
 // Interrupt vectors
 #define IRQ_VECTOR 0xFFFE
@@ -27,9 +33,28 @@
 
 #define B_Flag_Mask 0x10
 
+// Opcode handlers are usually inlined into cpu_execute(). Compiling
+// with -DPROFILE_HANDLERS keeps each one as a function named by its
+// mnemonic, so perf and other profilers show the time per instruction
+#ifdef PROFILE_HANDLERS
+    #define HANDLER static __attribute__((noinline))
+#else
+    #define HANDLER static
+#endif
+
 static int cycles;
+static uint64_t total_cycles = 0;
 static uint8_t IRQ_PIN_LEVEL = 1; // IRQ Pin level
 
+// Traps: index into the handlers for every address, 0 for none
+#define MAX_TRAPS 16
+static uint8_t trap_index[0x10000];
+static cpu_trap traps[MAX_TRAPS];
+static int trap_count = 1;
+
+// Host services called by the guest with opcode 0x02
+static cpu_trap hypercall = NULL;
+
 // 6502 registers
 static uint8_t A;   // Accumulator
 static uint8_t X;   // Index register X
@@ -91,6 +116,14 @@ static uint8_t get_P(void){
 
 
 
+// All the registers in a single word
+static uint64_t get_registers(void){
+    return ((uint64_t)A << 40) | ((uint64_t)X << 32) | ((uint64_t)Y << 24) |
+           ((uint64_t)SP << 16) | ((uint64_t)get_P() << 8) | IRQ_PIN_LEVEL;
+}
+
+
+
 // Some common tasks inside CPU
 
 
@@ -127,6 +160,7 @@ static uint16_t read_word(uint16_t address){
 
 // Fetch a byte from Program Counter and avance it acordingly
 static uint8_t fetch(void){
+    PROFILE_FETCH(PC);
     return read_byte(PC++);
 }
 
@@ -194,6 +228,7 @@ static void compare(uint8_t a, uint8_t b){
 
 // Performs an Interrupt Request
 static void do_irq(uint16_t vector){
+    PROBE2(cpu__irq, vector, PC);
     push16(PC);             // Push program counter
     push(get_P());          // Push Status register
     I_Flag = 0x01;          // Set Interrupt Disable flag
@@ -342,7 +377,7 @@ static uint16_t zeropageY(void){
 // Instruction cores
 // https://www.masswerk.at/6502/6502_instruction_set.html
 // ADC Add Memory to Accumulator with Carry
-static void ADC(uint16_t address){
+HANDLER void ADC(uint16_t address){
     uint8_t op1, op2;
     if(D_Flag){
         // Decimal mode
@@ -376,7 +411,7 @@ static void ADC(uint16_t address){
 
 
 //AND: AND Memory with Accumulator
-static void AND(uint16_t address){
+HANDLER void AND(uint16_t address){
     A &= read_byte(address);
     update_NZ(A);
 }
@@ -384,7 +419,7 @@ static void AND(uint16_t address){
 
 
 // ASL: Shift Left One Bit 
-static void ASL(uint16_t address){
+HANDLER void ASL(uint16_t address){
     uint8_t data = read_byte(address);
     C_Flag = data & 0x80;
     data <<= 1;
@@ -395,7 +430,7 @@ static void ASL(uint16_t address){
 
 
 // ASL: Shift Left Accumulator One Bit
-static void ASL_ACC(void){
+HANDLER void ASL_ACC(void){
     C_Flag = A & 0x80;
     A <<= 1;
     update_NZ(A);
@@ -407,7 +442,7 @@ static void ASL_ACC(void){
 // bits 7 and 6 of operand are transfered to bit 7 and 6 of
 // SR (N,V). the zero-flag is set to the result of operand
 // AND accumulator.
-static void BIT(uint16_t address){
+HANDLER void BIT(uint16_t address){
     uint8_t data = read_byte(address);
     N_Flag = data & 0x80;
     V_Flag = data & 0x40;
@@ -417,7 +452,7 @@ static void BIT(uint16_t address){
 
 
 // BRK: Force break
-static void BRK(void){
+HANDLER void BRK(void){
     PC++;                         // Skip break mark byte
     push16(PC);                   // Push program counter
     push(get_P() | B_Flag_Mask);  // Set B flag
@@ -428,13 +463,16 @@ static void BRK(void){
 
 
 // BXX: Branch on condition
-static void BXX(uint8_t condition){
+HANDLER void BXX(uint8_t condition){
     uint16_t e_address;
     uint8_t reljmp = read_byte(PC++);
     if(condition){
         cycles++; // Branch taken
         e_address = PC + (uint16_t)((int8_t)reljmp); // Ugly!
         if ((e_address & 0xFF00) != (PC & 0xFF00)) cycles++; // Branch to different page
+        if (options.flag_hang_detect && (e_address < PC)){
+            hang_sample(get_registers() | ((uint64_t)e_address << 48), e_address);
+        }
         PC = e_address;
     }
 }
@@ -442,56 +480,56 @@ static void BXX(uint8_t condition){
 
 
 // CLC: Clear carry
-static void CLC(void){
+HANDLER void CLC(void){
     C_Flag = 0x00;
 }
 
 
 
 // CLD: Clear decimal
-static void CLD(void){
+HANDLER void CLD(void){
     D_Flag = 0x00;
 }
 
 
 
 // CLI:Clear interrupt disable
-static void CLI(void){
+HANDLER void CLI(void){
     I_Flag = 0x00;
 }
 
 
 
 // CLV: Clear overflow
-static void CLV(void){
+HANDLER void CLV(void){
     V_Flag = 0x00;
 }
 
 
 
 // CMP: Compare Memory with Accumulator
-static void CMP(uint16_t address){
+HANDLER void CMP(uint16_t address){
     compare(A, read_byte(address));
 }
 
 
 
 // CPX: Compare Memory and Index X
-static void CPX(uint16_t address){
+HANDLER void CPX(uint16_t address){
     compare(X, read_byte(address));
 }
 
 
 
 // CPY: Compare Memory and Index Y
-static void CPY(uint16_t address){
+HANDLER void CPY(uint16_t address){
     compare(Y, read_byte(address));
 }
 
 
 
 // DEC: Decrement Memory by One
-static void DEC(uint16_t address){
+HANDLER void DEC(uint16_t address){
     uint8_t data = read_byte(address);
     data--;
     update_NZ(data);
@@ -501,7 +539,7 @@ static void DEC(uint16_t address){
 
 
 // DEX: Decrement X
-static void DEX(void){
+HANDLER void DEX(void){
     X--;
     update_NZ(X);    
 }
@@ -509,7 +547,7 @@ static void DEX(void){
 
 
 // DEY: Decrement Y
-static void DEY(void){
+HANDLER void DEY(void){
     Y--;
     update_NZ(Y);
 }
@@ -517,7 +555,7 @@ static void DEY(void){
 
 
 // EOR: Exclusive-OR Memory with Accumulator
-static void EOR(uint16_t address){
+HANDLER void EOR(uint16_t address){
     A ^= read_byte(address);
     update_NZ(A);
 }
@@ -525,7 +563,7 @@ static void EOR(uint16_t address){
 
 
 // INC: Increment Memory by One
-static void INC(uint16_t address){
+HANDLER void INC(uint16_t address){
     uint8_t data = read_byte(address);
     data++;
     update_NZ(data);
@@ -535,7 +573,7 @@ static void INC(uint16_t address){
 
 
 // INX: Increment X
-static void INX(void){
+HANDLER void INX(void){
     X++;
     update_NZ(X);
 }
@@ -543,7 +581,7 @@ static void INX(void){
 
 
 // INY: Increment Y
-static void INY(void){
+HANDLER void INY(void){
     Y++;
     update_NZ(Y);
 }
@@ -551,14 +589,17 @@ static void INY(void){
 
 
 // JMP: Jump to new location
-static void JMP(uint16_t address){
+HANDLER void JMP(uint16_t address){
+    if (options.flag_hang_detect && (address < PC)){
+        hang_sample(get_registers() | ((uint64_t)address << 48), address);
+    }
     PC = address;
 }
 
 
 
 // JSR: Jump to subroutine
-static void JSR(uint16_t address){
+HANDLER void JSR(uint16_t address){
     // https://retrocomputing.stackexchange.com/questions/19543/
     // why-does-the-6502-jsr-instruction-only-increment-the-re
     //turn-address-by-2-bytes
@@ -569,7 +610,7 @@ static void JSR(uint16_t address){
 
 
 // LDA: Load accumulator
-static void LDA(uint16_t address){
+HANDLER void LDA(uint16_t address){
     A = read_byte(address);
     update_NZ(A);
 }
@@ -577,7 +618,7 @@ static void LDA(uint16_t address){
 
 
 // LDX: Load X
-static void LDX(uint16_t address){
+HANDLER void LDX(uint16_t address){
     X = read_byte(address);
     update_NZ(X);
 }
@@ -585,7 +626,7 @@ static void LDX(uint16_t address){
 
 
 // LDY: Load Y
-static void LDY(uint16_t address){
+HANDLER void LDY(uint16_t address){
     Y = read_byte(address);
     update_NZ(Y);
 }
@@ -593,7 +634,7 @@ static void LDY(uint16_t address){
 
 
 // LSR: Shift One Bit Right
-static void LSR(uint16_t address){
+HANDLER void LSR(uint16_t address){
     uint8_t data = read_byte(address);
     C_Flag = data & 0x01;
     data >>= 1;
@@ -604,7 +645,7 @@ static void LSR(uint16_t address){
 
 
 // LSR: Shift Accumulator One Bit Right
-static void LSR_ACC(void){
+HANDLER void LSR_ACC(void){
     C_Flag = A & 0x01;
     A >>= 1;
     update_NZ(A);
@@ -613,7 +654,7 @@ static void LSR_ACC(void){
 
 
 // ORA: OR Memory with Accumulator
-static void ORA(uint16_t address){
+HANDLER void ORA(uint16_t address){
     A |= read_byte(address);
     update_NZ(A);
 }
@@ -621,21 +662,21 @@ static void ORA(uint16_t address){
 
 
 // PHA: Push Accumulator
-static void PHA(void){
+HANDLER void PHA(void){
     push(A);
 }
 
 
 
 // PHP: Push Processor Status on Stack
-static void PHP(void){
+HANDLER void PHP(void){
     push(get_P() | B_Flag_Mask); // B Flag should be active
 }
 
 
 
 // PLA: Pull Accumulator
-static void PLA(void){
+HANDLER void PLA(void){
     A = pop();
     update_NZ(A);
 }
@@ -643,14 +684,14 @@ static void PLA(void){
 
 
 // PLP: Pull Processor Status from Stack
-static void PLP(void){
+HANDLER void PLP(void){
     set_P(pop());
 }
 
 
 
 // ROL: Rotate Memory One Bit Left
-static void ROL(uint16_t address){
+HANDLER void ROL(uint16_t address){
     uint8_t data = read_byte(address);
     uint8_t oldC_Flag = C_Flag;
     C_Flag = data & 0x80;
@@ -663,7 +704,7 @@ static void ROL(uint16_t address){
 
 
 // ROL: Rotate Accumulator One Bit Left
-static void ROL_ACC(void){
+HANDLER void ROL_ACC(void){
     uint8_t oldC_Flag = C_Flag;
     C_Flag = A & 0x80;
     A <<= 1;
@@ -674,7 +715,7 @@ static void ROL_ACC(void){
 
 
 // ROR: Rotate One Bit Right
-static void ROR(uint16_t address){
+HANDLER void ROR(uint16_t address){
     uint8_t data = read_byte(address);
     uint8_t oldC_Flag = C_Flag;
     C_Flag = data & 0x01;
@@ -686,7 +727,7 @@ static void ROR(uint16_t address){
 
 
 
-static void ROR_ACC(void){
+HANDLER void ROR_ACC(void){
     uint8_t oldC_Flag = C_Flag;
     C_Flag = A & 0x01;
     A >>= 1;
@@ -697,7 +738,7 @@ static void ROR_ACC(void){
 
 
 // RTI: Return from interrupt
-static void RTI(void){
+HANDLER void RTI(void){
     set_P(pop());   // Pull status register
     PC = pop16();   // Pull program counter
 }
@@ -705,7 +746,7 @@ static void RTI(void){
 
 
 // RTS: Return from subroutine
-static void RTS(void){
+HANDLER void RTS(void){
     // https://retrocomputing.stackexchange.com/questions/19543/
     // why-does-the-6502-jsr-instruction-only-increment-the-re
     // turn-address-by-2-bytes
@@ -715,7 +756,7 @@ static void RTS(void){
 
 
 // SBC: Subtract with carry
-static void SBC(uint16_t address){   
+HANDLER void SBC(uint16_t address){   
     uint8_t op1, op2;
     uint16_t aux;
     if(D_Flag){
@@ -751,49 +792,49 @@ static void SBC(uint16_t address){
 
 
 // SEC: Set carry
-static void SEC(void){
+HANDLER void SEC(void){
     C_Flag = 0x01;
 }
 
 
 
 //SED: Set decimal
-static void SED(void){
+HANDLER void SED(void){
     D_Flag = 0x01;
 }
 
 
 
 //SEI: Set interrupt disable
-static void SEI(void){
+HANDLER void SEI(void){
     I_Flag = 0x01;
 }
 
 
 
 //STA: Store accumulator
-static void STA(uint16_t address){
+HANDLER void STA(uint16_t address){
     write_byte(address, A);
 }
 
 
 
 // STX: Store X
-static void STX(uint16_t address){
+HANDLER void STX(uint16_t address){
     write_byte(address, X);
 }
 
 
 
 // STY: Store Y
-static void STY(uint16_t address){
+HANDLER void STY(uint16_t address){
     write_byte(address, Y);
 }
 
 
 
 // TAX: Transfer accumulator to X
-static void TAX(void){
+HANDLER void TAX(void){
     X = A;
     update_NZ(X);
 }
@@ -801,7 +842,7 @@ static void TAX(void){
 
 
 // TAY: Transfer accumulator to Y
-static void TAY(void){
+HANDLER void TAY(void){
     Y = A;
     update_NZ(Y);
 }
@@ -809,7 +850,7 @@ static void TAY(void){
 
 
 // TSX: Transfer stack pointer to X
-static void TSX(void){
+HANDLER void TSX(void){
     X = SP;
     update_NZ(X);    
 }
@@ -817,7 +858,7 @@ static void TSX(void){
 
 
 // TXA: Transfer X to accumulator
-static void TXA(void){
+HANDLER void TXA(void){
     A = X;
     update_NZ(A);    
 }
@@ -825,14 +866,14 @@ static void TXA(void){
 
 
 // TXS: Transfer X to stack pointer
-static void TXS(void){
+HANDLER void TXS(void){
     SP = X;    
 }
 
 
 
 // TYA: Transfer Y to accumulator
-static void TYA(void){
+HANDLER void TYA(void){
     A = Y;
     update_NZ(A);
 }
@@ -840,7 +881,15 @@ static void TYA(void){
 
 
 static void illegal_opcode(uint8_t opcode){
-    fprintf(stderr, "\nError: illegal opcode 0x%02X at 0x%04X. Resseting CPU\n", opcode, PC - 1);
+    char where[SYMBOL_LENGTH + 8];
+    PROBE2(cpu__illegal, opcode, PC - 1);
+    symbols_describe(PC - 1, where, sizeof(where));
+    if (where[0] == '$'){
+        // No symbol nearby
+        fprintf(stderr, "\nError: illegal opcode 0x%02X at 0x%04X. Resseting CPU\n", opcode, PC - 1);
+    } else {
+        fprintf(stderr, "\nError: illegal opcode 0x%02X at 0x%04X (%s). Resseting CPU\n", opcode, PC - 1, where);
+    }
     cpu_reset();
 }
 
@@ -872,6 +921,7 @@ void cpu_reset(void){
     SP = 0xFD;
     set_P(0x36); // nv10dIZc
     PC = read_word(RST_VECTOR);
+    PROBE1(cpu__reset, PC);
 }
 
 
@@ -886,8 +936,21 @@ int cpu_execute(void){
         do_irq(IRQ_VECTOR);
     }
  
+    // Host routines replacing ROM routines
+    if (trap_index[PC]){
+        cpu_state state;
+        cpu_get_state(&state);
+        int trap_cycles = traps[trap_index[PC]](&state);
+        if (trap_cycles >= 0){
+            cpu_set_state(&state);
+            cycles += trap_cycles;
+            total_cycles += cycles;
+            return cycles;
+        }
+    }
+ 
     // Now, just interpret opcodes
-    uint8_t opcode = read_byte(PC++);
+    uint8_t opcode = fetch();
     
     // Here we go... the giant switch-case. Let's hope the
     // compiler can optimize it into a jump table ;-)
@@ -904,8 +967,15 @@ int cpu_execute(void){
             cycles += 6;
             break;
             
-        case 0x02:
-            illegal_opcode(opcode);
+        case 0x02: // Hypercall, if enabled
+            if (hypercall){
+                cpu_state state;
+                cpu_get_state(&state);
+                cycles += hypercall(&state);
+                cpu_set_state(&state);
+            } else {
+                illegal_opcode(opcode);
+            }
             break;
 
         case 0x03:
@@ -2069,6 +2139,71 @@ int cpu_execute(void){
             illegal_opcode(opcode);
             break; 
     }
+    total_cycles += cycles;
     return cycles;
 }
 
+
+
+// Cycles executed since power on, up
+// to the start of current instruction
+uint64_t cpu_total_cycles(void){
+    return total_cycles;
+}
+
+
+
+
+void cpu_get_state(cpu_state *state){
+    state->A = A;
+    state->X = X;
+    state->Y = Y;
+    state->SP = SP;
+    state->P = get_P();
+    state->irq_pin_level = IRQ_PIN_LEVEL;
+    state->PC = PC;
+    state->total_cycles = total_cycles;
+}
+
+
+
+void cpu_set_state(cpu_state *state){
+    A = state->A;
+    X = state->X;
+    Y = state->Y;
+    SP = state->SP;
+    set_P(state->P);
+    IRQ_PIN_LEVEL = state->irq_pin_level;
+    PC = state->PC;
+    total_cycles = state->total_cycles;
+}
+
+
+
+// Installs a trap at an address
+void cpu_set_trap(uint16_t address, cpu_trap handler){
+    if (trap_count == MAX_TRAPS){
+        fprintf(stderr, "Error: too many traps\n");
+        exit(EXIT_FAILURE);
+    }
+    traps[trap_count] = handler;
+    trap_index[address] = trap_count++;
+}
+
+
+
+// Enables opcode 0x02 as a call to host services
+void cpu_set_hypercall(cpu_trap handler){
+    hypercall = handler;
+}
+
+
+
+// Returns from the trapped routine as RTS would
+void cpu_trap_return(cpu_state *state){
+    state->SP++;
+    uint8_t low = read_byte(0x0100 | state->SP);
+    state->SP++;
+    uint8_t high = read_byte(0x0100 | state->SP);
+    state->PC = word(high, low) + 1;
+}
@@ -17,8 +17,31 @@
 #ifndef cpu6502_h
     #define cpu6502_h
     #include <stdint.h>
+
+    // CPU state, for snapshots
+    typedef struct{
+        uint8_t A;
+        uint8_t X;
+        uint8_t Y;
+        uint8_t SP;
+        uint8_t P;
+        uint8_t irq_pin_level;
+        uint16_t PC;
+        uint64_t total_cycles;
+    } cpu_state;
+
+    // Host routine run instead of the instruction at an address.
+    // Returns the cycles it took, or -1 to run the instruction
+    typedef int (*cpu_trap)(cpu_state *state);
+
     void cpu_irq(uint8_t level);
     void cpu_nmi(void);
     void cpu_reset(void);
     int cpu_execute(void);
+    uint64_t cpu_total_cycles(void);
+    void cpu_get_state(cpu_state *state);
+    void cpu_set_state(cpu_state *state);
+    void cpu_set_trap(uint16_t address, cpu_trap handler);
+    void cpu_trap_return(cpu_state *state);
+    void cpu_set_hypercall(cpu_trap handler);
 #endif 
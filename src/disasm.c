@@ -0,0 +1,419 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// 6502 disassembler and disassembly database of the ROM.
+//
+// The database tells code from data and marks the basic blocks
+// of the control flow graph, following every path from the
+// reset, NMI and IRQ vectors and from the symbols marked as code.
+// Building it means walking the whole ROM, so it is stored in
+// the cache directory ($XDG_CACHE_HOME/uk101re or ~/.cache/uk101re)
+// under the ROM hash and reused while neither the ROM, the code
+// entry points nor the memory map (video RAM and keyboard, which
+// hide parts of the ROM) change.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "disasm.h"
+#include "motherboard.h"
+#include "options.h"
+#include "symbols.h"
+
+#define DB_MAGIC "UK101DB"
+#define DB_VERSION 2
+
+// Addressing modes
+enum {
+    MODE_IMP, MODE_ACC, MODE_IMM, MODE_ZP, MODE_ZPX, MODE_ZPY, MODE_ABS,
+    MODE_ABX, MODE_ABY, MODE_IND, MODE_IZX, MODE_IZY, MODE_REL
+};
+
+static const int mode_length[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2};
+
+typedef struct{
+    char mnemonic[4];
+    uint8_t mode;
+} opcode_info;
+
+// Illegal opcodes are shown as ???
+static const opcode_info opcodes[256] = {
+    {"BRK", MODE_IMP}, {"ORA", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 00
+    {"???", MODE_IMP}, {"ORA", MODE_ZP}, {"ASL", MODE_ZP}, {"???", MODE_IMP},  // 04
+    {"PHP", MODE_IMP}, {"ORA", MODE_IMM}, {"ASL", MODE_ACC}, {"???", MODE_IMP},  // 08
+    {"???", MODE_IMP}, {"ORA", MODE_ABS}, {"ASL", MODE_ABS}, {"???", MODE_IMP},  // 0C
+    {"BPL", MODE_REL}, {"ORA", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 10
+    {"???", MODE_IMP}, {"ORA", MODE_ZPX}, {"ASL", MODE_ZPX}, {"???", MODE_IMP},  // 14
+    {"CLC", MODE_IMP}, {"ORA", MODE_ABY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 18
+    {"???", MODE_IMP}, {"ORA", MODE_ABX}, {"ASL", MODE_ABX}, {"???", MODE_IMP},  // 1C
+    {"JSR", MODE_ABS}, {"AND", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 20
+    {"BIT", MODE_ZP}, {"AND", MODE_ZP}, {"ROL", MODE_ZP}, {"???", MODE_IMP},  // 24
+    {"PLP", MODE_IMP}, {"AND", MODE_IMM}, {"ROL", MODE_ACC}, {"???", MODE_IMP},  // 28
+    {"BIT", MODE_ABS}, {"AND", MODE_ABS}, {"ROL", MODE_ABS}, {"???", MODE_IMP},  // 2C
+    {"BMI", MODE_REL}, {"AND", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 30
+    {"???", MODE_IMP}, {"AND", MODE_ZPX}, {"ROL", MODE_ZPX}, {"???", MODE_IMP},  // 34
+    {"SEC", MODE_IMP}, {"AND", MODE_ABY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 38
+    {"???", MODE_IMP}, {"AND", MODE_ABX}, {"ROL", MODE_ABX}, {"???", MODE_IMP},  // 3C
+    {"RTI", MODE_IMP}, {"EOR", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 40
+    {"???", MODE_IMP}, {"EOR", MODE_ZP}, {"LSR", MODE_ZP}, {"???", MODE_IMP},  // 44
+    {"PHA", MODE_IMP}, {"EOR", MODE_IMM}, {"LSR", MODE_ACC}, {"???", MODE_IMP},  // 48
+    {"JMP", MODE_ABS}, {"EOR", MODE_ABS}, {"LSR", MODE_ABS}, {"???", MODE_IMP},  // 4C
+    {"BVC", MODE_REL}, {"EOR", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 50
+    {"???", MODE_IMP}, {"EOR", MODE_ZPX}, {"LSR", MODE_ZPX}, {"???", MODE_IMP},  // 54
+    {"CLI", MODE_IMP}, {"EOR", MODE_ABY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 58
+    {"???", MODE_IMP}, {"EOR", MODE_ABX}, {"LSR", MODE_ABX}, {"???", MODE_IMP},  // 5C
+    {"RTS", MODE_IMP}, {"ADC", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 60
+    {"???", MODE_IMP}, {"ADC", MODE_ZP}, {"ROR", MODE_ZP}, {"???", MODE_IMP},  // 64
+    {"PLA", MODE_IMP}, {"ADC", MODE_IMM}, {"ROR", MODE_ACC}, {"???", MODE_IMP},  // 68
+    {"JMP", MODE_IND}, {"ADC", MODE_ABS}, {"ROR", MODE_ABS}, {"???", MODE_IMP},  // 6C
+    {"BVS", MODE_REL}, {"ADC", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 70
+    {"???", MODE_IMP}, {"ADC", MODE_ZPX}, {"ROR", MODE_ZPX}, {"???", MODE_IMP},  // 74
+    {"SEI", MODE_IMP}, {"ADC", MODE_ABY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 78
+    {"???", MODE_IMP}, {"ADC", MODE_ABX}, {"ROR", MODE_ABX}, {"???", MODE_IMP},  // 7C
+    {"???", MODE_IMP}, {"STA", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 80
+    {"STY", MODE_ZP}, {"STA", MODE_ZP}, {"STX", MODE_ZP}, {"???", MODE_IMP},  // 84
+    {"DEY", MODE_IMP}, {"???", MODE_IMP}, {"TXA", MODE_IMP}, {"???", MODE_IMP},  // 88
+    {"STY", MODE_ABS}, {"STA", MODE_ABS}, {"STX", MODE_ABS}, {"???", MODE_IMP},  // 8C
+    {"BCC", MODE_REL}, {"STA", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 90
+    {"STY", MODE_ZPX}, {"STA", MODE_ZPX}, {"STX", MODE_ZPY}, {"???", MODE_IMP},  // 94
+    {"TYA", MODE_IMP}, {"STA", MODE_ABY}, {"TXS", MODE_IMP}, {"???", MODE_IMP},  // 98
+    {"???", MODE_IMP}, {"STA", MODE_ABX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // 9C
+    {"LDY", MODE_IMM}, {"LDA", MODE_IZX}, {"LDX", MODE_IMM}, {"???", MODE_IMP},  // A0
+    {"LDY", MODE_ZP}, {"LDA", MODE_ZP}, {"LDX", MODE_ZP}, {"???", MODE_IMP},  // A4
+    {"TAY", MODE_IMP}, {"LDA", MODE_IMM}, {"TAX", MODE_IMP}, {"???", MODE_IMP},  // A8
+    {"LDY", MODE_ABS}, {"LDA", MODE_ABS}, {"LDX", MODE_ABS}, {"???", MODE_IMP},  // AC
+    {"BCS", MODE_REL}, {"LDA", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // B0
+    {"LDY", MODE_ZPX}, {"LDA", MODE_ZPX}, {"LDX", MODE_ZPY}, {"???", MODE_IMP},  // B4
+    {"CLV", MODE_IMP}, {"LDA", MODE_ABY}, {"TSX", MODE_IMP}, {"???", MODE_IMP},  // B8
+    {"LDY", MODE_ABX}, {"LDA", MODE_ABX}, {"LDX", MODE_ABY}, {"???", MODE_IMP},  // BC
+    {"CPY", MODE_IMM}, {"CMP", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // C0
+    {"CPY", MODE_ZP}, {"CMP", MODE_ZP}, {"DEC", MODE_ZP}, {"???", MODE_IMP},  // C4
+    {"INY", MODE_IMP}, {"CMP", MODE_IMM}, {"DEX", MODE_IMP}, {"???", MODE_IMP},  // C8
+    {"CPY", MODE_ABS}, {"CMP", MODE_ABS}, {"DEC", MODE_ABS}, {"???", MODE_IMP},  // CC
+    {"BNE", MODE_REL}, {"CMP", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // D0
+    {"???", MODE_IMP}, {"CMP", MODE_ZPX}, {"DEC", MODE_ZPX}, {"???", MODE_IMP},  // D4
+    {"CLD", MODE_IMP}, {"CMP", MODE_ABY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // D8
+    {"???", MODE_IMP}, {"CMP", MODE_ABX}, {"DEC", MODE_ABX}, {"???", MODE_IMP},  // DC
+    {"CPX", MODE_IMM}, {"SBC", MODE_IZX}, {"???", MODE_IMP}, {"???", MODE_IMP},  // E0
+    {"CPX", MODE_ZP}, {"SBC", MODE_ZP}, {"INC", MODE_ZP}, {"???", MODE_IMP},  // E4
+    {"INX", MODE_IMP}, {"SBC", MODE_IMM}, {"NOP", MODE_IMP}, {"???", MODE_IMP},  // E8
+    {"CPX", MODE_ABS}, {"SBC", MODE_ABS}, {"INC", MODE_ABS}, {"???", MODE_IMP},  // EC
+    {"BEQ", MODE_REL}, {"SBC", MODE_IZY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // F0
+    {"???", MODE_IMP}, {"SBC", MODE_ZPX}, {"INC", MODE_ZPX}, {"???", MODE_IMP},  // F4
+    {"SED", MODE_IMP}, {"SBC", MODE_ABY}, {"???", MODE_IMP}, {"???", MODE_IMP},  // F8
+    {"???", MODE_IMP}, {"SBC", MODE_ABX}, {"INC", MODE_ABX}, {"???", MODE_IMP},  // FC
+};
+
+static uint8_t database[0x10000];
+static uint8_t database_ready = 0;
+
+
+
+int disasm_length(uint8_t opcode){
+    return mode_length[opcodes[opcode].mode];
+}
+
+
+
+// Name for an address used as operand: its symbol, a generated
+// label for blocks in the database, or relative to a symbol
+static void operand_name(uint16_t address, char *buffer, size_t size){
+    const char *name = symbols_name(address);
+    if (name){
+        snprintf(buffer, size, "%s", name);
+    } else if (database_ready && (database[address] & DB_BLOCK)){
+        snprintf(buffer, size, "L%04X", address);
+    } else {
+        symbols_describe(address, buffer, size);
+    }
+}
+
+
+
+// Writes the instruction at an address. Returns its length
+int disasm_format(uint16_t address, char *buffer, size_t size){
+    const opcode_info *info = &opcodes[motherboard_peek(address)];
+    uint8_t low = motherboard_peek(address + 1);
+    uint16_t word = low | (motherboard_peek(address + 2) << 8);
+    char name[SYMBOL_LENGTH + 8];
+    
+    switch (info->mode){
+        case MODE_IMP: snprintf(buffer, size, "%s", info->mnemonic); break;
+        case MODE_ACC: snprintf(buffer, size, "%s A", info->mnemonic); break;
+        case MODE_IMM: snprintf(buffer, size, "%s #$%02X", info->mnemonic, low); break;
+        case MODE_ZP:  snprintf(buffer, size, "%s $%02X", info->mnemonic, low); break;
+        case MODE_ZPX: snprintf(buffer, size, "%s $%02X,X", info->mnemonic, low); break;
+        case MODE_ZPY: snprintf(buffer, size, "%s $%02X,Y", info->mnemonic, low); break;
+        case MODE_IZX: snprintf(buffer, size, "%s ($%02X,X)", info->mnemonic, low); break;
+        case MODE_IZY: snprintf(buffer, size, "%s ($%02X),Y", info->mnemonic, low); break;
+        case MODE_ABS:
+            operand_name(word, name, sizeof(name));
+            snprintf(buffer, size, "%s %s", info->mnemonic, name);
+            break;
+        case MODE_ABX:
+            operand_name(word, name, sizeof(name));
+            snprintf(buffer, size, "%s %s,X", info->mnemonic, name);
+            break;
+        case MODE_ABY:
+            operand_name(word, name, sizeof(name));
+            snprintf(buffer, size, "%s %s,Y", info->mnemonic, name);
+            break;
+        case MODE_IND:
+            operand_name(word, name, sizeof(name));
+            snprintf(buffer, size, "%s (%s)", info->mnemonic, name);
+            break;
+        case MODE_REL:
+            operand_name(address + 2 + (int8_t)low, name, sizeof(name));
+            snprintf(buffer, size, "%s %s", info->mnemonic, name);
+            break;
+    }
+    return mode_length[info->mode];
+}
+
+
+
+// Follows every path from an entry point, marking the instructions
+static void trace(uint16_t entry, uint8_t flags){
+    static uint16_t pending[0x10000];
+    int count = 0;
+    
+    if (!motherboard_is_rom(entry)){
+        return;
+    }
+    database[entry] |= DB_BLOCK | flags;
+    pending[count++] = entry;
+    
+    while (count){
+        uint16_t address = pending[--count];
+        while (motherboard_is_rom(address) && !(database[address] & DB_INSTRUCTION)){
+            uint8_t opcode = motherboard_peek(address);
+            const opcode_info *info = &opcodes[opcode];
+            int length = mode_length[info->mode];
+            uint16_t target = motherboard_peek(address + 1) | (motherboard_peek(address + 2) << 8);
+            
+            // Stop at data and at bytes already decoded
+            // as part of a different instruction
+            if (info->mnemonic[0] == '?'){
+                break;
+            }
+            if ((database[address] & DB_CODE) ||
+                ((length > 1) && (database[(uint16_t)(address + 1)] & DB_CODE)) ||
+                ((length > 2) && (database[(uint16_t)(address + 2)] & DB_CODE))){
+                break;
+            }
+            database[address] |= DB_INSTRUCTION;
+            for (int i = 0; i < length; i++){
+                database[(uint16_t)(address + i)] |= DB_CODE;
+            }
+            address += length;
+            
+            if (info->mode == MODE_REL){
+                // Branches: both ways, new blocks on each
+                target = address + (int8_t)(target & 0xFF);
+                if (motherboard_is_rom(target)){
+                    database[target] |= DB_BLOCK;
+                    pending[count++] = target;
+                }
+                database[address] |= DB_BLOCK;
+            } else if ((opcode == 0x20) || (opcode == 0x4C)){
+                // JSR and JMP absolute
+                if (motherboard_is_rom(target)){
+                    database[target] |= DB_BLOCK | DB_ROUTINE;
+                    pending[count++] = target;
+                }
+                if (opcode == 0x4C){
+                    break;
+                }
+                database[address] |= DB_BLOCK;
+            } else if ((opcode == 0x00) || (opcode == 0x40) || (opcode == 0x60) || (opcode == 0x6C)){
+                // BRK, RTI, RTS and JMP indirect end the path
+                break;
+            }
+        }
+    }
+}
+
+
+
+static void build_database(void){
+    memset(database, 0, sizeof(database));
+    trace(motherboard_peek(0xFFFC) | (motherboard_peek(0xFFFD) << 8), DB_ROUTINE);
+    trace(motherboard_peek(0xFFFA) | (motherboard_peek(0xFFFB) << 8), DB_ROUTINE);
+    trace(motherboard_peek(0xFFFE) | (motherboard_peek(0xFFFF) << 8), DB_ROUTINE);
+    for (int i = 0; i < symbols_count(); i++){
+        if (symbols_get(i)->code){
+            trace(symbols_get(i)->address, DB_ROUTINE);
+        }
+    }
+}
+
+
+
+// Path of the database file for the ROM, NULL if there
+// is no cache directory. Creates the directory if needed
+static char *database_path(void){
+    static char path[4096];
+    char *base = getenv("XDG_CACHE_HOME");
+    char *home = getenv("HOME");
+    
+    if (base && *base){
+        mkdir(base, 0755);
+        snprintf(path, sizeof(path), "%s/uk101re", base);
+    } else if (home && *home){
+        snprintf(path, sizeof(path), "%s/.cache", home);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/.cache/uk101re", home);
+    } else {
+        return NULL;
+    }
+    if (mkdir(path, 0755) && (errno != EEXIST)){
+        return NULL;
+    }
+    snprintf(path + strlen(path), sizeof(path) - strlen(path),
+        "/%016" PRIx64 ".db", motherboard_rom_hash());
+    return path;
+}
+
+
+
+// Devices mapped over the ROM area
+static uint32_t memory_map(void){
+    return options.video | (options.flag_keyboard << 8);
+}
+
+
+
+static int load_database(char *path){
+    char magic[sizeof(DB_MAGIC)];
+    uint32_t version;
+    uint32_t map;
+    uint64_t hash;
+    int ok;
+    
+    FILE *f = fopen(path, "rb");
+    if (f == NULL){
+        return 0;
+    }
+    ok = (fread(magic, 1, sizeof(magic), f) == sizeof(magic)) &&
+        !memcmp(magic, DB_MAGIC, sizeof(magic)) &&
+        (fread(&version, 1, sizeof(version), f) == sizeof(version)) &&
+        (version == DB_VERSION) &&
+        (fread(&map, 1, sizeof(map), f) == sizeof(map)) &&
+        (map == memory_map()) &&
+        (fread(&hash, 1, sizeof(hash), f) == sizeof(hash)) &&
+        (hash == symbols_hash()) &&
+        (fread(database, 1, sizeof(database), f) == sizeof(database));
+    fclose(f);
+    return ok;
+}
+
+
+
+static void save_database(char *path){
+    char tempname[4096 + 4];
+    uint32_t version = DB_VERSION;
+    uint32_t map = memory_map();
+    uint64_t hash = symbols_hash();
+    
+    snprintf(tempname, sizeof(tempname), "%s.tmp", path);
+    FILE *f = fopen(tempname, "wb");
+    if (f == NULL){
+        return;
+    }
+    fwrite(DB_MAGIC, 1, sizeof(DB_MAGIC), f);
+    fwrite(&version, 1, sizeof(version), f);
+    fwrite(&map, 1, sizeof(map), f);
+    fwrite(&hash, 1, sizeof(hash), f);
+    fwrite(database, 1, sizeof(database), f);
+    if (fclose(f) || rename(tempname, path)){
+        remove(tempname);
+    }
+}
+
+
+
+// Returns the database of the ROM, loading it from
+// the cache or building it and saving it there
+const uint8_t *disasm_database(void){
+    if (!database_ready){
+        char *path = database_path();
+        if ((path == NULL) || !load_database(path)){
+            build_database();
+            if (path){
+                save_database(path);
+            }
+        }
+        database_ready = 1;
+    }
+    return database;
+}
+
+
+
+// Writes a listing of the ROM: code as instructions with
+// labels at the basic blocks, anything else as data bytes
+void disasm_listing(char *filename){
+    const uint8_t *db = disasm_database();
+    char text[64], label[SYMBOL_LENGTH + 8];
+    long address = 0x8000;
+    
+    FILE *f = fopen(filename, "w");
+    if (f == NULL){
+        fprintf(stderr, "Error: can't create %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    while (address <= 0xFFFF){
+        if (!motherboard_is_rom(address)){
+            address++;
+            continue;
+        }
+        if (db[address] & (DB_BLOCK | DB_ROUTINE) || symbols_name(address)){
+            if (db[address] & DB_ROUTINE){
+                fprintf(f, "\n");
+            }
+            operand_name(address, label, sizeof(label));
+            fprintf(f, "%s:\n", label);
+        }
+        if (db[address] & DB_INSTRUCTION){
+            int length = disasm_format(address, text, sizeof(text));
+            fprintf(f, "%04lX  ", address);
+            for (int i = 0; i < 3; i++){
+                if (i < length){
+                    fprintf(f, "%02X ", motherboard_peek(address + i));
+                } else {
+                    fprintf(f, "   ");
+                }
+            }
+            fprintf(f, "  %s\n", text);
+            address += length;
+        } else {
+            // Data up to 8 bytes, until the next code or label
+            fprintf(f, "%04lX  .BYTE $%02X", address, motherboard_peek(address));
+            address++;
+            for (int i = 1; (i < 8) && motherboard_is_rom(address) && !db[address] && !symbols_name(address); i++){
+                fprintf(f, ",$%02X", motherboard_peek(address));
+                address++;
+            }
+            fprintf(f, "\n");
+        }
+    }
+    fclose(f);
+}
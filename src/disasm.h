@@ -0,0 +1,32 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef disasm_h
+    #define disasm_h
+    #include <stddef.h>
+    #include <stdint.h>
+
+    // Flags of every address in the disassembly database
+    #define DB_CODE 0x01        // Part of an instruction
+    #define DB_INSTRUCTION 0x02 // First byte of an instruction
+    #define DB_BLOCK 0x04       // Starts a basic block
+    #define DB_ROUTINE 0x08     // Target of a JSR or a JMP, or entry point
+
+    int disasm_length(uint8_t opcode);
+    int disasm_format(uint16_t address, char *buffer, size_t size);
+    const uint8_t *disasm_database(void);
+    void disasm_listing(char *filename);
+#endif
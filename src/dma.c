@@ -0,0 +1,161 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// DMA controller: a block transfer device at DMA_BASE, taking
+// 16 bytes of the ACIA address range when enabled with --dma.
+//
+//   Offset  Register
+//   0-1     Source (low, high)
+//   2-3     Destination (low, high)
+//   4-5     Length (low, high)
+//   6-7     File name (low, high), a zero terminated string
+//   8       Fill value
+//   9       Write: command. Read: status
+//
+// Commands are 1 copy, 2 fill, 3 read a file into the
+// destination (length is set to the bytes read) and 4 write
+// the source to a file. Status bit 7 is set while busy and
+// bit 6 if the last command failed, so BIT sets N and V.
+// Host work is done at once, but the transfer is busy for
+// --dma-cycles cycles per byte and registers can't be written
+// until then. Files are only reachable with --dma-dir, and
+// their names can't contain paths
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu6502.h"
+#include "dma.h"
+#include "hangdetect.h"
+#include "hypercall.h"
+#include "options.h"
+
+#define DMA_SETUP_CYCLES 4
+
+#define REG_SOURCE 0
+#define REG_DEST 2
+#define REG_LENGTH 4
+#define REG_NAME 6
+#define REG_VALUE 8
+#define REG_COMMAND 9
+
+#define COMMAND_COPY 1
+#define COMMAND_FILL 2
+#define COMMAND_READ 3
+#define COMMAND_WRITE 4
+
+#define STATUS_BUSY 0x80
+#define STATUS_ERROR 0x40
+
+static uint8_t REG[16];
+static uint8_t STATUS;
+static uint64_t done_at;
+
+
+
+static uint16_t word(int reg){
+    return REG[reg] | (REG[reg + 1] << 8);
+}
+
+
+
+static void set_word(int reg, uint16_t value){
+    REG[reg] = value & 0xFF;
+    REG[reg + 1] = value >> 8;
+}
+
+
+
+static int busy(void){
+    if ((STATUS & STATUS_BUSY) && (cpu_total_cycles() >= done_at)){
+        STATUS &= ~STATUS_BUSY;
+    }
+    return STATUS & STATUS_BUSY;
+}
+
+
+
+static void start(uint8_t command){
+    uint16_t length = word(REG_LENGTH);
+    int ok = 0;
+    
+    switch (command){
+        case COMMAND_COPY:  ok = hypercall_copy(word(REG_SOURCE), word(REG_DEST), length); break;
+        case COMMAND_FILL:  ok = hypercall_fill(word(REG_DEST), length, REG[REG_VALUE]); break;
+        case COMMAND_READ:  ok = hypercall_read_file(options.dma_dir, word(REG_NAME), word(REG_DEST), &length); break;
+        case COMMAND_WRITE: ok = hypercall_write_file(options.dma_dir, word(REG_NAME), word(REG_SOURCE), length); break;
+    }
+    if (ok){
+        set_word(REG_LENGTH, length);
+    } else {
+        length = 0;
+    }
+    STATUS = STATUS_BUSY | (ok ? 0 : STATUS_ERROR);
+    done_at = cpu_total_cycles() + DMA_SETUP_CYCLES + (uint64_t)length * options.dma_cycles;
+}
+
+
+
+void dma_reset(void){
+    memset(REG, 0, sizeof(REG));
+    STATUS = 0;
+}
+
+
+
+uint8_t dma_readbyte(uint16_t address){
+    int reg = address & 0x000F;
+    
+    if (reg == REG_COMMAND){
+        if (busy()){
+            // Waiting for a transfer is not hung
+            hang_io();
+        }
+        return STATUS;
+    }
+    return REG[reg];
+}
+
+
+
+void dma_writebyte(uint16_t address, uint8_t data){
+    int reg = address & 0x000F;
+    
+    if (busy()){
+        return;
+    }
+    if (reg == REG_COMMAND){
+        start(data);
+    } else {
+        REG[reg] = data;
+    }
+}
+
+
+
+void dma_get_state(dma_state *state){
+    memcpy(state->REG, REG, sizeof(REG));
+    state->STATUS = STATUS;
+    state->done_at = done_at;
+}
+
+
+
+void dma_set_state(dma_state *state){
+    memcpy(REG, state->REG, sizeof(REG));
+    STATUS = state->STATUS;
+    done_at = state->done_at;
+}
@@ -0,0 +1,38 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef dma_h
+    #define dma_h
+    #include <stdint.h>
+
+    // Registers, decoded at DMA_BASE when enabled
+    #define DMA_BASE 0xF400
+    #define DMA_END 0xF40F
+    #define DMA_DEFAULT_CYCLES 1
+
+    // Registers and transfer in progress, for snapshots
+    typedef struct{
+        uint8_t REG[16];
+        uint8_t STATUS;
+        uint64_t done_at;
+    } dma_state;
+
+    void dma_reset(void);
+    uint8_t dma_readbyte(uint16_t address);
+    void dma_writebyte(uint16_t address, uint8_t data);
+    void dma_get_state(dma_state *state);
+    void dma_set_state(dma_state *state);
+#endif
@@ -0,0 +1,159 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Memory dumps. Address ranges are written to binary files, or
+// to Intel HEX files when their name ends in .hex or .ihx, when
+// the emulator quits, after a number of cycles, when the program
+// prints a marker text, or when Ctrl-W is pressed
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "dump.h"
+#include "motherboard.h"
+#include "options.h"
+#include "stats.h"
+
+#define MARKER_MAX 64
+
+
+static uint8_t cycles_done = 0;
+static uint8_t last_output[MARKER_MAX];
+static int marker_length;
+
+
+
+static void write_ihex(FILE *f, uint16_t start, uint16_t end){
+    long address = start;
+    while (address <= end){
+        uint8_t length = (end - address + 1 < 16) ? end - address + 1 : 16;
+        uint8_t sum = length + (address >> 8) + (address & 0xFF);
+        fprintf(f, ":%02X%04lX00", length, address);
+        for (int i = 0; i < length; i++){
+            uint8_t byte = motherboard_peek(address + i);
+            sum += byte;
+            fprintf(f, "%02X", byte);
+        }
+        fprintf(f, "%02X\n", (uint8_t)-sum);
+        address += length;
+    }
+    fprintf(f, ":00000001FF\n");
+}
+
+
+
+static void write_binary(FILE *f, uint16_t start, uint16_t end){
+    for (long address = start; address <= end; address++){
+        fputc(motherboard_peek(address), f);
+    }
+}
+
+
+
+// Writes every dump file. A file that can't be written is
+// reported and skipped: the computer keeps running, and this
+// also runs from an exit hook
+void dump_write(void){
+    for (int i = 0; i < options.dump_count; i++){
+        char *filename = options.dump[i];
+        char *dot = strrchr(filename, '.');
+        char *tempname = malloc(strlen(filename) + 5);
+        sprintf(tempname, "%s.tmp", filename);
+        
+        FILE *f = fopen(tempname, "wb");
+        if (f == NULL){
+            fprintf(stderr, "Error: can't create %s\n", tempname);
+            free(tempname);
+            continue;
+        }
+        if (dot && (!strcasecmp(dot, ".hex") || !strcasecmp(dot, ".ihx"))){
+            write_ihex(f, options.dump_start[i], options.dump_end[i]);
+        } else {
+            write_binary(f, options.dump_start[i], options.dump_end[i]);
+        }
+        if (ferror(f) | fclose(f) || rename(tempname, filename)){
+            fprintf(stderr, "Error: can't write %s\n", filename);
+            remove(tempname);
+        }
+        free(tempname);
+    }
+}
+
+
+
+// Shortens a slice so the dump happens at the exact cycle
+long dump_slice(long slice){
+    if (options.dump_cycles && !cycles_done){
+        uint64_t left = options.dump_cycles - stats.cycles;
+        if (left < (uint64_t)slice){
+            slice = (long)left;
+        }
+    }
+    return slice;
+}
+
+
+
+// Called after every slice
+void dump_check(void){
+    if (options.dump_cycles && !cycles_done && (stats.cycles >= options.dump_cycles)){
+        cycles_done = 1;
+        dump_write();
+    }
+}
+
+
+
+// Called for every byte printed. Dumps right away when the
+// last bytes printed are the marker
+void dump_output(uint8_t byte){
+    if (!marker_length){
+        return;
+    }
+    memmove(last_output, last_output + 1, marker_length - 1);
+    last_output[marker_length - 1] = byte;
+    if (!memcmp(last_output, options.dump_marker, marker_length)){
+        dump_write();
+    }
+}
+
+
+
+// Executed whenever the program exits
+static void dump_hook(void){
+    dump_write();
+}
+
+
+
+void configure_dump(void){
+    if (!options.dump_count){
+        return;
+    }
+    if (options.dump_marker){
+        marker_length = strlen(options.dump_marker);
+        if ((marker_length == 0) || (marker_length > MARKER_MAX)){
+            fprintf(stderr, "Error: dump marker must have 1 to %d characters\n", MARKER_MAX);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (!options.dump_cycles && !options.dump_marker){
+        atexit(dump_hook);
+    }
+}
@@ -0,0 +1,340 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Floating point coprocessor, at FPU_BASE when enabled with
+// --fpu. Numbers are in the 4 byte format of the UK101 BASIC:
+// an exponent biased by 128 (0 means zero) and a 24 bit
+// mantissa, most significant byte first, whose top bit is
+// replaced by the sign.
+//
+//   Offset  Register
+//   0-3     X, first operand and result
+//   4-7     Y, second operand
+//   8       Write: operation (FPU_ADD...). Read: status
+//
+// Operations finish at once. Status bit 6 is set if the last
+// one failed (overflow, division by zero or a value out of the
+// domain of the function), leaving X as it was.
+//
+// The patch file given with --fpu-patch routes BASIC through
+// the coprocessor. Its lines have an hexadecimal address and a
+// name, like symbol files (addresses depend on the ROM):
+//
+//   00AC fac       FAC, unpacked: exponent, mantissa, sign
+//   00B4 arg       ARG, unpacked too
+//   00B1 ext       Rounding byte of FAC, cleared (optional)
+//   B8D3 mul       Routine doing FAC = ARG * FAC
+//   BC26 sqr       Routine doing FAC = SQR(FAC)
+//
+// Routines are add, sub, mul, div, sqr, sin, cos, tan, atn,
+// log and exp, with ARG as Y and FAC as X. A trap on each one
+// hands the work to the coprocessor and returns as its RTS
+// would. On errors the ROM routine runs instead, so BASIC still
+// reports them
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu6502.h"
+#include "fpu.h"
+#include "hangdetect.h"
+#include "motherboard.h"
+#include "options.h"
+
+// Cycles charged for a patched BASIC routine
+#define FPU_CYCLES 50
+
+#define REG_X 0
+#define REG_Y 4
+#define REG_COMMAND 8
+
+#define STATUS_ERROR 0x40
+
+static uint8_t REG[16];
+static uint8_t STATUS;
+
+// Patched routines
+static const char *names[] = {NULL, "add", "sub", "mul", "div", "sqr", "sin", "cos", "tan", "atn", "log", "exp"};
+#define OPERATIONS (sizeof(names) / sizeof(names[0]))
+static uint8_t operation[0x10000];
+static long fac = -1;
+static long arg = -1;
+static long ext = -1;
+
+
+
+// Converts an exponent, a mantissa with its top bit set
+// and a sign to a double
+static double to_double(uint8_t exponent, uint32_t mantissa, uint8_t negative){
+    if (exponent == 0){
+        return 0.0;
+    }
+    double value = ldexp(mantissa, exponent - 128 - 24);
+    return negative ? -value : value;
+}
+
+
+
+// Converts a double, returns 0 if out of range
+static int from_double(double value, uint8_t *exponent, uint32_t *mantissa, uint8_t *negative){
+    int power;
+    
+    if (!isfinite(value)){
+        return 0;
+    }
+    *negative = (value < 0);
+    double fraction = frexp(fabs(value), &power);
+    uint32_t bits = (uint32_t)llround(ldexp(fraction, 24));
+    if (bits == 0x1000000){
+        bits >>= 1;
+        power++;
+    }
+    if ((value == 0.0) || (power + 128 < 1)){
+        // Zero or too small
+        *exponent = 0;
+        *mantissa = 0;
+        *negative = 0;
+        return 1;
+    }
+    if (power + 128 > 255){
+        return 0;
+    }
+    *exponent = power + 128;
+    *mantissa = bits;
+    return 1;
+}
+
+
+
+static double packed(const uint8_t *bytes){
+    uint32_t mantissa = ((bytes[1] | 0x80) << 16) | (bytes[2] << 8) | bytes[3];
+    return to_double(bytes[0], mantissa, bytes[1] & 0x80);
+}
+
+
+
+static int pack(double value, uint8_t *bytes){
+    uint8_t exponent, negative;
+    uint32_t mantissa;
+    
+    if (!from_double(value, &exponent, &mantissa, &negative)){
+        return 0;
+    }
+    bytes[0] = exponent;
+    bytes[1] = ((mantissa >> 16) & 0x7F) | (negative ? 0x80 : 0);
+    bytes[2] = (mantissa >> 8) & 0xFF;
+    bytes[3] = mantissa & 0xFF;
+    if (exponent == 0){
+        memset(bytes, 0, 4);
+    }
+    return 1;
+}
+
+
+
+// Does an operation, returns 0 on error
+static int calculate(int op, double y, double *x){
+    double r;
+    
+    switch (op){
+        case FPU_ADD: r = y + *x; break;
+        case FPU_SUB: r = y - *x; break;
+        case FPU_MUL: r = y * *x; break;
+        case FPU_DIV:
+            if (*x == 0.0){
+                return 0;
+            }
+            r = y / *x;
+            break;
+        case FPU_SQR:
+            if (*x < 0.0){
+                return 0;
+            }
+            r = sqrt(*x);
+            break;
+        case FPU_SIN: r = sin(*x); break;
+        case FPU_COS: r = cos(*x); break;
+        case FPU_TAN: r = tan(*x); break;
+        case FPU_ATN: r = atan(*x); break;
+        case FPU_LOG:
+            if (*x <= 0.0){
+                return 0;
+            }
+            r = log(*x);
+            break;
+        case FPU_EXP: r = exp(*x); break;
+        default:
+            return 0;
+    }
+    *x = r;
+    return isfinite(r);
+}
+
+
+
+void fpu_reset(void){
+    memset(REG, 0, sizeof(REG));
+    STATUS = 0;
+}
+
+
+
+uint8_t fpu_readbyte(uint16_t address){
+    int reg = address & 0x000F;
+    
+    if (reg == REG_COMMAND){
+        return STATUS;
+    }
+    return REG[reg];
+}
+
+
+
+void fpu_writebyte(uint16_t address, uint8_t data){
+    int reg = address & 0x000F;
+    double x;
+    uint8_t result[4];
+    
+    // Registers are not part of the hang detector state,
+    // so changing them counts as I/O
+    if (reg != REG_COMMAND){
+        if (REG[reg] != data){
+            REG[reg] = data;
+            hang_io();
+        }
+        return;
+    }
+    x = packed(&REG[REG_X]);
+    if (calculate(data, packed(&REG[REG_Y]), &x) && pack(x, result)){
+        if (memcmp(&REG[REG_X], result, 4) || STATUS){
+            memcpy(&REG[REG_X], result, 4);
+            STATUS = 0;
+            hang_io();
+        }
+    } else if (STATUS != STATUS_ERROR){
+        STATUS = STATUS_ERROR;
+        hang_io();
+    }
+}
+
+
+
+void fpu_get_state(fpu_state *state){
+    memcpy(state->REG, REG, sizeof(REG));
+    state->STATUS = STATUS;
+}
+
+
+
+void fpu_set_state(fpu_state *state){
+    memcpy(REG, state->REG, sizeof(REG));
+    STATUS = state->STATUS;
+}
+
+
+
+// Reads an unpacked BASIC accumulator from RAM
+static double unpacked(uint16_t address){
+    uint32_t mantissa = (motherboard_peek(address + 1) << 16) | (motherboard_peek(address + 2) << 8) | motherboard_peek(address + 3);
+    return to_double(motherboard_peek(address), mantissa, motherboard_peek(address + 4) & 0x80);
+}
+
+
+
+// Patched BASIC routine
+static int basic_trap(cpu_state *state){
+    double x = unpacked(fac);
+    uint8_t bytes[5];
+    uint32_t mantissa;
+    
+    if (!calculate(operation[state->PC], unpacked(arg), &x) || !from_double(x, &bytes[0], &mantissa, &bytes[4])){
+        return -1;
+    }
+    bytes[1] = mantissa >> 16;
+    bytes[2] = (mantissa >> 8) & 0xFF;
+    bytes[3] = mantissa & 0xFF;
+    bytes[4] = bytes[4] ? 0xFF : 0x00;
+    motherboard_write_ram(fac, bytes, sizeof(bytes));
+    if (ext >= 0){
+        bytes[0] = 0;
+        motherboard_write_ram(ext, bytes, 1);
+    }
+    cpu_trap_return(state);
+    return FPU_CYCLES;
+}
+
+
+
+static void load_patch(char *filename){
+    char line[256], name[16];
+    unsigned int address;
+    int number = 0;
+    
+    FILE *f = fopen(filename, "r");
+    if (f == NULL){
+        fprintf(stderr, "Error: can't open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), f)){
+        number++;
+        line[strcspn(line, ";#\n")] = 0;
+        int fields = sscanf(line, "%x %15s", &address, name);
+        if (fields <= 0){
+            // Blank line or comment
+            continue;
+        }
+        if ((fields < 2) || (address > 0xFFFF)){
+            fprintf(stderr, "Error: bad patch in %s, line %d\n", filename, number);
+            exit(EXIT_FAILURE);
+        }
+        if (!strcmp(name, "fac")){
+            fac = address;
+        } else if (!strcmp(name, "arg")){
+            arg = address;
+        } else if (!strcmp(name, "ext")){
+            ext = address;
+        } else {
+            unsigned int op;
+            for (op = 1; op < OPERATIONS; op++){
+                if (!strcmp(name, names[op])){
+                    break;
+                }
+            }
+            if (op == OPERATIONS){
+                fprintf(stderr, "Error: unknown routine %s in %s, line %d\n", name, filename, number);
+                exit(EXIT_FAILURE);
+            }
+            operation[address] = op;
+            cpu_set_trap(address, basic_trap);
+        }
+    }
+    fclose(f);
+    if ((fac < 0) || (arg < 0)){
+        fprintf(stderr, "Error: %s needs the fac and arg addresses\n", filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+void configure_fpu(void){
+    if (options.fpu_patch){
+        load_patch(options.fpu_patch);
+    }
+}
@@ -0,0 +1,50 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef fpu_h
+    #define fpu_h
+    #include <stdint.h>
+
+    // Registers, decoded at FPU_BASE when enabled
+    #define FPU_BASE 0xF410
+    #define FPU_END 0xF41F
+
+    // Operations, X is the first operand and the result
+    #define FPU_ADD 1   // X = Y + X
+    #define FPU_SUB 2   // X = Y - X
+    #define FPU_MUL 3   // X = Y * X
+    #define FPU_DIV 4   // X = Y / X
+    #define FPU_SQR 5
+    #define FPU_SIN 6
+    #define FPU_COS 7
+    #define FPU_TAN 8
+    #define FPU_ATN 9
+    #define FPU_LOG 10
+    #define FPU_EXP 11
+
+    // Registers, for snapshots
+    typedef struct{
+        uint8_t REG[16];
+        uint8_t STATUS;
+    } fpu_state;
+
+    void fpu_reset(void);
+    uint8_t fpu_readbyte(uint16_t address);
+    void fpu_writebyte(uint16_t address, uint8_t data);
+    void fpu_get_state(fpu_state *state);
+    void fpu_set_state(fpu_state *state);
+    void configure_fpu(void);
+#endif
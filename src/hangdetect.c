@@ -0,0 +1,93 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Hung program detector
+//
+// A program is hung when the whole machine state repeats with
+// no I/O in between: from then on it will loop forever. The
+// state is RAM plus CPU registers. RAM is hashed incrementally,
+// XORing one term per non zero byte (so the hash of a page is
+// the XOR of its bytes terms, and the RAM hash the XOR of the
+// pages hashes). CPU registers are added when sampling.
+//
+// Samples are taken at loop heads (backward branches and jumps)
+// and looked for cycles with Brent's algorithm, which needs a
+// single saved sample.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hangdetect.h"
+
+static uint64_t ram_hash = 0;
+static uint64_t saved;
+static uint8_t have_saved = 0;
+static uint64_t power = 1;
+static uint64_t length = 0;
+
+
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x){
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+
+
+// Hash term for a byte of RAM. Zero bytes don't
+// contribute, so the hash of an empty RAM is zero
+static uint64_t term(uint16_t address, uint8_t data){
+    return data ? mix(((uint64_t)address << 8) | data) : 0;
+}
+
+
+
+void hang_ram_write(uint16_t address, uint8_t old_data, uint8_t new_data){
+    ram_hash ^= term(address, old_data) ^ term(address, new_data);
+}
+
+
+
+// Called at every loop head
+void hang_sample(uint64_t registers, uint16_t pc){
+    uint64_t state = ram_hash ^ mix(registers ^ 0x5555555555555555ULL);
+    
+    if (have_saved && (state == saved)){
+        fprintf(stderr, "\n*** Hung program detected at 0x%04X ***\n", pc);
+        exit(EXIT_HUNG);
+    }
+    
+    if (++length == power){
+        saved = state;
+        have_saved = 1;
+        power <<= 1;
+        length = 0;
+    }
+}
+
+
+
+// Any I/O may change what the program does next,
+// so previous states are not relevant anymore
+void hang_io(void){
+    have_saved = 0;
+    power = 1;
+    length = 0;
+}
@@ -0,0 +1,27 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef hangdetect_h
+    #define hangdetect_h
+    #include <stdint.h>
+
+    // Exit code when a hung program is detected
+    #define EXIT_HUNG 3
+
+    void hang_ram_write(uint16_t address, uint8_t old_data, uint8_t new_data);
+    void hang_sample(uint64_t registers, uint16_t pc);
+    void hang_io(void);
+#endif
@@ -0,0 +1,96 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define SUB_MASK (SUB_BUCKETS - 1)
+
+
+
+// Bucket where a value is counted. Values below 16 have their
+// own bucket; above that, the most significant bit selects the
+// group and the next 4 bits select the bucket inside the group
+static int bucket_index(uint64_t value){
+    if (value < SUB_BUCKETS){
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)((value >> shift) & SUB_MASK);
+}
+
+
+
+// Highest value that would be counted in a bucket
+static uint64_t bucket_value(int index){
+    if (index < SUB_BUCKETS){
+        return (uint64_t)index;
+    }
+    int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)(SUB_BUCKETS + (index & SUB_MASK)) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+
+
+void histogram_record(histogram *h, uint64_t value){
+    h->buckets[bucket_index(value)]++;
+    h->count++;
+    if (value > h->max){
+        h->max = value;
+    }
+}
+
+
+
+// Returns the value below which the given
+// percentage (0 - 100) of the samples fall
+uint64_t histogram_percentile(histogram *h, double percentile){
+    if (h->count == 0){
+        return 0;
+    }
+    uint64_t target = (uint64_t)(h->count * percentile / 100.0 + 0.5);
+    if (target == 0){
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++){
+        seen += h->buckets[i];
+        if (seen >= target){
+            uint64_t value = bucket_value(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+
+
+// Prints a summary line. Values are
+// recorded in ns but shown in us
+void histogram_print(FILE *f, const char *name, histogram *h){
+    fprintf(f, "%-20s n=%" PRIu64 " p50=%" PRIu64 " p99=%" PRIu64 " p999=%" PRIu64 " max=%" PRIu64 " us\n",
+        name, h->count,
+        histogram_percentile(h, 50.0) / 1000,
+        histogram_percentile(h, 99.0) / 1000,
+        histogram_percentile(h, 99.9) / 1000,
+        h->max / 1000);
+}
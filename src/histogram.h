@@ -0,0 +1,36 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef histogram_h
+    #define histogram_h
+    #include <stdint.h>
+    #include <stdio.h>
+
+    // Log-linear histogram: every power of two is split
+    // into 16 buckets, so values are kept within 6.25%
+    #define HISTOGRAM_SUB_BITS 4
+    #define HISTOGRAM_BUCKETS (64 << HISTOGRAM_SUB_BITS)
+
+    typedef struct{
+        uint64_t count;
+        uint64_t max;
+        uint64_t buckets[HISTOGRAM_BUCKETS];
+    } histogram;
+
+    void histogram_record(histogram *h, uint64_t value);
+    uint64_t histogram_percentile(histogram *h, double percentile);
+    void histogram_print(FILE *f, const char *name, histogram *h);
+#endif
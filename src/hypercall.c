@@ -0,0 +1,290 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Hypercalls: opcode 0x02, unused by the 6502, calls a host
+// service when enabled. A selects the service and X (low) and
+// Y (high) point to its parameter block, made of 16 bit little
+// endian words. On return the carry flag is set on error and
+// A holds the result. Each call takes 20 cycles plus one per
+// byte processed.
+//
+//   A  Service  Parameters               Result
+//   0  Copy     source, dest, length     (overlapping is fine)
+//   1  Fill     dest, length, value (1)
+//   2  Compare  string1, string2         A = 0, 1 or 0xFF, and Z, N
+//   3  Read     name, dest, length       length = bytes read (block in RAM)
+//   4  Write    name, source, length
+//   5  Time     dest                     4 bytes Unix time, 2 bytes ms
+//
+// Strings end with a zero. Files are only reachable with
+// --hypercall-dir, and their names can't contain paths
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu6502.h"
+#include "hypercall.h"
+#include "motherboard.h"
+#include "options.h"
+
+#define HYPERCALL_CYCLES 20
+#define NAME_MAX_LENGTH 64
+
+#define C_FLAG 0x01
+#define Z_FLAG 0x02
+#define N_FLAG 0x80
+
+
+static int cycles;
+
+
+
+static uint16_t parameter(uint16_t block, int index){
+    return motherboard_peek(block + 2 * index) | (motherboard_peek(block + 2 * index + 1) << 8);
+}
+
+
+
+static void set_parameter(uint16_t block, int index, uint16_t value){
+    uint8_t bytes[2] = {value & 0xFF, value >> 8};
+    motherboard_write_ram(block + 2 * index, bytes, 2);
+}
+
+
+
+// Returns whether a range can be written
+static int in_ram(long address, long length){
+    return address + length <= RAMSIZE;
+}
+
+
+
+// Reads a file name from the guest and makes its path inside
+// a host directory. Names are letters, digits, '.', '_' and
+// '-' and can't start with a dot. Returns 0 if not allowed
+int hypercall_file_path(const char *dir, uint16_t address, char *path, size_t size){
+    char name[NAME_MAX_LENGTH + 1];
+    int i;
+    
+    if (dir == NULL){
+        return 0;
+    }
+    for (i = 0; i <= NAME_MAX_LENGTH; i++){
+        name[i] = motherboard_peek(address + i);
+        if (name[i] == 0){
+            break;
+        }
+        if (!isalnum((unsigned char)name[i]) && !strchr("._-", name[i])){
+            return 0;
+        }
+    }
+    if ((i == 0) || (i > NAME_MAX_LENGTH) || (name[0] == '.')){
+        return 0;
+    }
+    snprintf(path, size, "%s/%s", dir, name);
+    return 1;
+}
+
+
+
+// Memory and file services, shared with the DMA controller.
+// Each returns 0 on error
+
+static uint8_t buffer[0x10000];
+
+
+
+int hypercall_copy(uint16_t source, uint16_t dest, uint16_t length){
+    if (!in_ram(dest, length)){
+        return 0;
+    }
+    for (long i = 0; i < length; i++){
+        buffer[i] = motherboard_peek(source + i);
+    }
+    motherboard_write_ram(dest, buffer, length);
+    return 1;
+}
+
+
+
+int hypercall_fill(uint16_t dest, uint16_t length, uint8_t value){
+    if (!in_ram(dest, length)){
+        return 0;
+    }
+    memset(buffer, value, length);
+    motherboard_write_ram(dest, buffer, length);
+    return 1;
+}
+
+
+
+// Reads up to length bytes of a file in dir into RAM
+// and sets length to the bytes read
+int hypercall_read_file(const char *dir, uint16_t name, uint16_t dest, uint16_t *length){
+    char path[4096];
+    
+    if (!in_ram(dest, *length) || !hypercall_file_path(dir, name, path, sizeof(path))){
+        return 0;
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL){
+        return 0;
+    }
+    *length = fread(buffer, 1, *length, f);
+    fclose(f);
+    motherboard_write_ram(dest, buffer, *length);
+    return 1;
+}
+
+
+
+int hypercall_write_file(const char *dir, uint16_t name, uint16_t source, uint16_t length){
+    char path[4096];
+    
+    if (!hypercall_file_path(dir, name, path, sizeof(path))){
+        return 0;
+    }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL){
+        return 0;
+    }
+    for (long i = 0; i < length; i++){
+        fputc(motherboard_peek(source + i), f);
+    }
+    return !fclose(f);
+}
+
+
+
+static int copy(uint16_t block){
+    uint16_t length = parameter(block, 2);
+    
+    if (!hypercall_copy(parameter(block, 0), parameter(block, 1), length)){
+        return 0;
+    }
+    cycles += length;
+    return 1;
+}
+
+
+
+static int fill(uint16_t block){
+    uint16_t length = parameter(block, 1);
+    
+    if (!hypercall_fill(parameter(block, 0), length, motherboard_peek(block + 4))){
+        return 0;
+    }
+    cycles += length;
+    return 1;
+}
+
+
+
+static int compare(uint16_t block, cpu_state *state){
+    uint16_t a = parameter(block, 0);
+    uint16_t b = parameter(block, 1);
+    uint8_t x, y;
+    
+    do {
+        x = motherboard_peek(a++);
+        y = motherboard_peek(b++);
+        cycles++;
+    } while ((x == y) && x);
+    state->A = (x == y) ? 0 : ((x > y) ? 1 : 0xFF);
+    return 1;
+}
+
+
+
+static int read_file(uint16_t block){
+    uint16_t length = parameter(block, 2);
+    
+    // The length read is written back to the block
+    if (!in_ram(block, 6) ||
+        !hypercall_read_file(options.hypercall_dir, parameter(block, 0), parameter(block, 1), &length)){
+        return 0;
+    }
+    set_parameter(block, 2, length);
+    cycles += length;
+    return 1;
+}
+
+
+
+static int write_file(uint16_t block){
+    uint16_t length = parameter(block, 2);
+    int ok;
+    
+    ok = hypercall_write_file(options.hypercall_dir, parameter(block, 0), parameter(block, 1), length);
+    cycles += length;
+    return ok;
+}
+
+
+
+static int host_time(uint16_t block){
+    struct timespec now;
+    uint16_t dest = parameter(block, 0);
+    uint8_t bytes[6];
+    
+    if (!in_ram(dest, sizeof(bytes))){
+        return 0;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint32_t seconds = now.tv_sec;
+    uint16_t ms = now.tv_nsec / 1000000;
+    for (int i = 0; i < 4; i++){
+        bytes[i] = seconds >> (8 * i);
+    }
+    bytes[4] = ms & 0xFF;
+    bytes[5] = ms >> 8;
+    motherboard_write_ram(dest, bytes, sizeof(bytes));
+    return 1;
+}
+
+
+
+static int hypercall(cpu_state *state){
+    uint16_t block = state->X | (state->Y << 8);
+    int ok = 0;
+    
+    cycles = HYPERCALL_CYCLES;
+    switch (state->A){
+        case HYPERCALL_COPY:    ok = copy(block); break;
+        case HYPERCALL_FILL:    ok = fill(block); break;
+        case HYPERCALL_COMPARE: ok = compare(block, state); break;
+        case HYPERCALL_READ:    ok = read_file(block); break;
+        case HYPERCALL_WRITE:   ok = write_file(block); break;
+        case HYPERCALL_TIME:    ok = host_time(block); break;
+    }
+    if (state->A != HYPERCALL_COMPARE){
+        state->A = ok ? 0 : 0xFF;
+    }
+    state->P &= ~(C_FLAG | Z_FLAG | N_FLAG);
+    state->P |= (ok ? 0 : C_FLAG) | (state->A ? 0 : Z_FLAG) | (state->A & N_FLAG);
+    return cycles;
+}
+
+
+
+void configure_hypercall(void){
+    if (options.flag_hypercall){
+        cpu_set_hypercall(hypercall);
+    }
+}
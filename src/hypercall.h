@@ -0,0 +1,36 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef hypercall_h
+    #define hypercall_h
+    #include <stddef.h>
+    #include <stdint.h>
+
+    // Services, selected by A
+    #define HYPERCALL_COPY 0
+    #define HYPERCALL_FILL 1
+    #define HYPERCALL_COMPARE 2
+    #define HYPERCALL_READ 3
+    #define HYPERCALL_WRITE 4
+    #define HYPERCALL_TIME 5
+
+    void configure_hypercall(void);
+    int hypercall_file_path(const char *dir, uint16_t address, char *path, size_t size);
+    int hypercall_copy(uint16_t source, uint16_t dest, uint16_t length);
+    int hypercall_fill(uint16_t dest, uint16_t length, uint8_t value);
+    int hypercall_read_file(const char *dir, uint16_t name, uint16_t dest, uint16_t *length);
+    int hypercall_write_file(const char *dir, uint16_t name, uint16_t source, uint16_t length);
+#endif
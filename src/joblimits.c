@@ -0,0 +1,99 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "joblimits.h"
+#include "options.h"
+#include "stats.h"
+#include "terminal.h"
+#include "timeutils.h"
+
+static struct timespec start_time;
+
+
+
+// Shows where the job was when a limit was reached, and quits
+static void limit_reached(const char *limit, int code){
+    struct timespec now, elapsed;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timerspecsub(&now, &start_time, &elapsed);
+    
+    fprintf(stderr, "\n*** %s limit reached ***\n", limit);
+    fprintf(stderr, "Cycles: %" PRIu64 ", instructions: %" PRIu64 ", output: %" PRIu64 " bytes, time: %ld ms, idle: %ld ms\n",
+        stats.cycles, stats.instructions, stats.output_bytes, timespec_to_ms(&elapsed), terminal_idle_time() / 1000000L);
+    exit(code);
+}
+
+
+
+void configure_limits(void){
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+
+
+// Shortens a slice so it doesn't go past the cycles limit, nor
+// the instructions limit (instructions take at least 2 cycles)
+long limits_slice(long slice){
+    if (options.max_cycles){
+        uint64_t left = options.max_cycles - stats.cycles;
+        if (left < (uint64_t)slice){
+            slice = (long)left;
+        }
+    }
+    if (options.max_instructions){
+        uint64_t left = options.max_instructions - stats.instructions;
+        if (left < (uint64_t)slice / 2){
+            slice = (long)left * 2;
+        }
+    }
+    return slice;
+}
+
+
+
+// Called after every slice
+void limits_check(void){
+    if (options.max_cycles && (stats.cycles >= options.max_cycles)){
+        limit_reached("Cycle", EXIT_MAX_CYCLES);
+    }
+    
+    if (options.max_instructions && (stats.instructions >= options.max_instructions)){
+        limit_reached("Instruction", EXIT_MAX_INSTRUCTIONS);
+    }
+    
+    if (options.max_output && (stats.output_bytes > options.max_output)){
+        limit_reached("Output", EXIT_MAX_OUTPUT);
+    }
+    
+    if (options.max_time){
+        struct timespec now, elapsed;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timerspecsub(&now, &start_time, &elapsed);
+        if (elapsed.tv_sec >= options.max_time){
+            limit_reached("Time", EXIT_MAX_TIME);
+        }
+    }
+    
+    if (options.max_idle && (terminal_idle_time() >= options.max_idle * 1000000000L)){
+        limit_reached("Idle", EXIT_MAX_IDLE);
+    }
+}
@@ -0,0 +1,31 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef joblimits_h
+    #define joblimits_h
+
+    // Exit codes when a limit is reached. 3 is used
+    // by the hung program detector (see hangdetect.h)
+    #define EXIT_MAX_CYCLES 4
+    #define EXIT_MAX_OUTPUT 5
+    #define EXIT_MAX_TIME 6
+    #define EXIT_MAX_IDLE 7
+    #define EXIT_MAX_INSTRUCTIONS 8
+
+    void configure_limits(void);
+    long limits_slice(long slice);
+    void limits_check(void);
+#endif
@@ -0,0 +1,257 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Keyboard matrix of the original UK101, at 0xDF00 and its
+// mirrors from KEYBOARD_BASE. Writing selects rows, with a 0
+// bit for each row scanned, and reading returns the columns of
+// those rows, with a 0 bit for each key down.
+//
+// Typed characters (and the datafile) are turned into the keys
+// that make them, SHIFT or CTRL included, held down for
+// KEY_HOLD cycles and then released for KEY_GAP cycles so the
+// ROM sees every press, even of the same key twice. SHIFT LOCK
+// is always down, as the ROM expects for capitals. The column
+// byte for every possible row selection is worked out when keys
+// change, so the constant scanning of the ROM is a table lookup.
+//
+// Only key changes count as I/O for the hang detector, as the
+// ROM scans the keyboard all the time. When there is nothing
+// to type, IDLE_POLLS reads each less than IDLE_GAP cycles
+// apart mean the ROM is waiting for a key, as with the ACIA
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu6502.h"
+#include "hangdetect.h"
+#include "keyboard.h"
+#include "terminal.h"
+
+// Emulated cycles a key stays down and then up
+#define KEY_HOLD 25000
+#define KEY_GAP 25000
+
+#define IDLE_POLLS 16
+#define IDLE_GAP 64
+
+// Keys as row * 8 + column
+#define KEY(row, column) ((row) * 8 + (column))
+#define KEY_NONE 0xFF
+#define KEY_SHIFT_LOCK KEY(0, 0)
+#define KEY_SHIFT KEY(0, 2)
+#define KEY_ESC KEY(0, 5)
+#define KEY_CTRL KEY(0, 6)
+
+// Characters in each row, from column 7 down.
+// Rows 1 and 2 hold fewer keys
+static const char *rows[8] = {
+    NULL,
+    "890:-\x7F",
+    ".LO\n\r",
+    "WERTYUI",
+    "SDFGHJK",
+    "XCVBNM,",
+    "QAZ /;P",
+    "1234567"
+};
+
+// Shifted characters and their unshifted key
+static const char shifted[] = "!1\"2#3$4%5&6'7(8)9*:=-+;<,>.?/";
+
+// Character to key, and whether SHIFT is needed
+static uint8_t key_of[128];
+static uint8_t shift_of[128];
+
+static uint8_t matrix[8];    // Columns of each row, 1 = down
+static uint8_t columns[256]; // What is read for a row selection
+static uint8_t row_select;
+
+static uint8_t holding;      // A key is down
+static uint64_t next_change;
+
+static uint64_t last_poll;
+static int empty_polls;
+
+
+
+static void build_map(void){
+    memset(key_of, KEY_NONE, sizeof(key_of));
+    memset(shift_of, 0, sizeof(shift_of));
+    for (int row = 1; row < 8; row++){
+        const char *keys = rows[row];
+        for (int i = 0; keys[i]; i++){
+            uint8_t ch = keys[i];
+            key_of[ch] = KEY(row, 7 - i);
+            if ((ch >= 'A') && (ch <= 'Z')){
+                key_of[ch + 0x20] = KEY(row, 7 - i);
+            }
+        }
+    }
+    for (int i = 0; shifted[i]; i += 2){
+        key_of[(uint8_t)shifted[i]] = key_of[(uint8_t)shifted[i + 1]];
+        shift_of[(uint8_t)shifted[i]] = 1;
+    }
+    key_of[0x08] = key_of[0x7F];
+    key_of[0x1B] = KEY_ESC;
+}
+
+
+
+static void press(uint8_t key){
+    matrix[key >> 3] |= 1 << (key & 7);
+}
+
+
+
+// Works out the columns read for every row selection
+static void update_columns(void){
+    for (int select = 0; select < 256; select++){
+        uint8_t down = 0;
+        for (int row = 0; row < 8; row++){
+            if (!(select & (1 << row))){
+                down |= matrix[row];
+            }
+        }
+        columns[select] = ~down;
+    }
+}
+
+
+
+// Releases all keys but SHIFT LOCK
+static void release(void){
+    memset(matrix, 0, sizeof(matrix));
+    press(KEY_SHIFT_LOCK);
+}
+
+
+
+// Presses the keys for the next typed character, if any
+static void type_next(void){
+    uint8_t ch = read_keyboard() & 0x7F;
+    uint8_t key = key_of[ch];
+    
+    if ((key == KEY_NONE) && (ch >= 0x01) && (ch <= 0x1A)){
+        // Control character: CTRL and a letter
+        key = key_of[ch + 0x40];
+        press(KEY_CTRL);
+    }
+    if (key == KEY_NONE){
+        return;
+    }
+    if (shift_of[ch]){
+        press(KEY_SHIFT);
+    }
+    press(key);
+    holding = 1;
+}
+
+
+
+// Moves on to the next key state when its time is over.
+// Returns 1 if keys are still changing
+static int step(void){
+    uint64_t now = cpu_total_cycles();
+    
+    if (now < next_change){
+        return 1;
+    }
+    if (holding){
+        release();
+        holding = 0;
+        next_change = now + KEY_GAP;
+    } else if (check_keyboard_ready()){
+        type_next();
+        next_change = now + KEY_HOLD;
+    } else {
+        return 0;
+    }
+    update_columns();
+    return 1;
+}
+
+
+
+// Nothing to type: tells a ROM waiting for a key from
+// the occasional scans done while running a program
+static void poll(void){
+    uint64_t now = cpu_total_cycles();
+    
+    if (now - last_poll < IDLE_GAP){
+        // Waiting for input is not hung
+        empty_polls++;
+        hang_io();
+    } else {
+        empty_polls = 0;
+    }
+    last_poll = now;
+    if (empty_polls >= IDLE_POLLS){
+        // Block instead of spinning if possible
+        terminal_wait_input();
+        empty_polls = 0;
+    }
+}
+
+
+
+void keyboard_reset(void){
+    build_map();
+    release();
+    update_columns();
+    row_select = 0xFF;
+    holding = 0;
+    next_change = 0;
+    empty_polls = 0;
+}
+
+
+
+uint8_t keyboard_readbyte(uint16_t address){
+    if (step()){
+        // What is read depends on time
+        hang_io();
+        empty_polls = 0;
+    } else {
+        poll();
+    }
+    return columns[row_select];
+}
+
+
+
+void keyboard_writebyte(uint16_t address, uint8_t data){
+    row_select = data;
+}
+
+
+
+void keyboard_get_state(keyboard_state *state){
+    memcpy(state->matrix, matrix, sizeof(matrix));
+    state->row_select = row_select;
+    state->holding = holding;
+    state->next_change = next_change;
+}
+
+
+
+void keyboard_set_state(keyboard_state *state){
+    memcpy(matrix, state->matrix, sizeof(matrix));
+    row_select = state->row_select;
+    holding = state->holding;
+    next_change = state->next_change;
+    empty_polls = 0;
+    update_columns();
+}
@@ -0,0 +1,38 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef keyboard_h
+    #define keyboard_h
+    #include <stdint.h>
+
+    // Keyboard matrix port of the original UK101
+    #define KEYBOARD_BASE 0xDC00
+    #define KEYBOARD_END 0xDFFF
+
+    // Keys down and their timing, for snapshots
+    typedef struct{
+        uint8_t matrix[8];
+        uint8_t row_select;
+        uint8_t holding;
+        uint64_t next_change;
+    } keyboard_state;
+
+    void keyboard_reset(void);
+    uint8_t keyboard_readbyte(uint16_t address);
+    void keyboard_writebyte(uint16_t address, uint8_t data);
+    void keyboard_get_state(keyboard_state *state);
+    void keyboard_set_state(keyboard_state *state);
+#endif
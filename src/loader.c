@@ -0,0 +1,272 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Machine code loader. Loads binary, Intel HEX and Motorola
+// S-record files straight into RAM after reset, instead of
+// typing them into the monitor. The format comes from the file
+// extension: .hex and .ihx are Intel HEX, .srec, .s19, .s28,
+// .s37 and .mot are S-records, anything else is binary and
+// needs a load address. SIGHUP loads the files again while
+// the computer runs. Files are parsed into a staging image
+// first, and RAM only changes if all of them are valid, so a
+// half written rebuild never stops or corrupts the computer
+
+#include <ctype.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cpu6502.h"
+#include "loader.h"
+#include "motherboard.h"
+#include "options.h"
+#include "terminal.h"
+
+// Staging image, and which of its bytes were loaded
+static uint8_t image[RAMSIZE];
+static uint8_t loaded[RAMSIZE];
+
+
+
+// Copies a block into the image of RAM, which is the
+// only place where loaded code can go
+static int load_block(const char *filename, long address, const uint8_t *data, long length){
+    if ((address < 0) || (address + length > RAMSIZE)){
+        fprintf(stderr, "Error: %s loads outside RAM at 0x%04lX\n", filename, address);
+        return 0;
+    }
+    memcpy(image + address, data, length);
+    memset(loaded + address, 1, length);
+    return 1;
+}
+
+
+
+// Parses 'count' hex bytes of a record line
+static int hex_bytes(const char *text, uint8_t *data, int count){
+    for (int i = 0; i < count; i++){
+        unsigned int byte;
+        if (!isxdigit((unsigned char)text[2 * i]) || !isxdigit((unsigned char)text[2 * i + 1]) ||
+            (sscanf(text + 2 * i, "%2x", &byte) != 1)){
+            return 0;
+        }
+        data[i] = byte;
+    }
+    return 1;
+}
+
+
+
+static int bad_line(const char *format, const char *filename, int number){
+    fprintf(stderr, "Error: bad %s file %s, line %d\n", format, filename, number);
+    return 0;
+}
+
+
+
+// Intel HEX: ':' count, address, type, data and checksum.
+// Handles data, end of file and both extended address records
+static int load_ihex(const char *filename, FILE *f){
+    char line[600];
+    uint8_t record[256 + 5];
+    long base = 0;
+    int number = 0;
+    
+    while (fgets(line, sizeof(line), f)){
+        uint8_t sum = 0;
+        number++;
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0){
+            continue;
+        }
+        if ((line[0] != ':') || !hex_bytes(line + 1, record, 1) ||
+            (strlen(line) != 11 + 2 * (size_t)record[0]) ||
+            !hex_bytes(line + 1, record, record[0] + 5)){
+            return bad_line("Intel HEX", filename, number);
+        }
+        for (int i = 0; i < record[0] + 5; i++){
+            sum += record[i];
+        }
+        if (sum){
+            return bad_line("Intel HEX", filename, number);
+        }
+        long address = (record[1] << 8) | record[2];
+        switch (record[3]){
+            case 0x00: // Data
+                if (!load_block(filename, base + address, record + 4, record[0])){
+                    return 0;
+                }
+                break;
+            case 0x01: // End of file
+                return 1;
+            case 0x02: // Extended segment address
+                base = ((record[4] << 8) | record[5]) << 4;
+                break;
+            case 0x04: // Extended linear address
+                base = (long)((record[4] << 8) | record[5]) << 16;
+                break;
+            default:   // Start addresses
+                break;
+        }
+    }
+    return 1;
+}
+
+
+
+// Motorola S-records: 'S', type, count, address, data and
+// checksum. S1, S2 and S3 have 16, 24 and 32 bit addresses
+static int load_srec(const char *filename, FILE *f){
+    char line[600];
+    uint8_t record[256];
+    int number = 0;
+    
+    while (fgets(line, sizeof(line), f)){
+        uint8_t sum = 0;
+        int address_size;
+        number++;
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0){
+            continue;
+        }
+        if ((line[0] != 'S') || !isdigit((unsigned char)line[1]) ||
+            !hex_bytes(line + 2, record, 1) ||
+            (strlen(line) != 4 + 2 * (size_t)record[0]) ||
+            !hex_bytes(line + 2, record, record[0] + 1)){
+            return bad_line("S-record", filename, number);
+        }
+        for (int i = 0; i <= record[0]; i++){
+            sum += record[i];
+        }
+        if (sum != 0xFF){
+            return bad_line("S-record", filename, number);
+        }
+        switch (line[1]){
+            case '1': address_size = 2; break;
+            case '2': address_size = 3; break;
+            case '3': address_size = 4; break;
+            default:  continue; // Header, counts and start addresses
+        }
+        if (record[0] < address_size + 1){
+            return bad_line("S-record", filename, number);
+        }
+        long address = 0;
+        for (int i = 0; i < address_size; i++){
+            address = (address << 8) | record[1 + i];
+        }
+        if (!load_block(filename, address, record + 1 + address_size, record[0] - address_size - 1)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+
+static int load_binary(const char *filename, FILE *f, long address){
+    static uint8_t data[RAMSIZE + 1];
+    long length = fread(data, 1, sizeof(data), f);
+    if (address < 0){
+        fprintf(stderr, "Error: binary file %s needs a load address\n", filename);
+        return 0;
+    }
+    return load_block(filename, address, data, length);
+}
+
+
+
+static int has_extension(const char *filename, const char *extensions[]){
+    const char *dot = strrchr(filename, '.');
+    for (int i = 0; dot && extensions[i]; i++){
+        if (!strcasecmp(dot + 1, extensions[i])){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+// Loads every file given in the options and sets the program
+// counter to the entry point, if any. Returns 0, leaving RAM
+// and the CPU untouched, if any file can't be loaded
+int loader_load(void){
+    static const char *ihex[] = {"hex", "ihx", NULL};
+    static const char *srec[] = {"srec", "s19", "s28", "s37", "mot", NULL};
+    int ok;
+    
+    memset(loaded, 0, sizeof(loaded));
+    for (int i = 0; i < options.load_count; i++){
+        char *filename = options.load[i];
+        FILE *f = fopen(filename, "rb");
+        if (f == NULL){
+            fprintf(stderr, "Error: can't open %s\n", filename);
+            return 0;
+        }
+        if (has_extension(filename, ihex)){
+            ok = load_ihex(filename, f);
+        } else if (has_extension(filename, srec)){
+            ok = load_srec(filename, f);
+        } else {
+            ok = load_binary(filename, f, options.load_address[i]);
+        }
+        fclose(f);
+        if (!ok){
+            return 0;
+        }
+    }
+    
+    // Every file is fine: copy the loaded runs into RAM
+    for (long start = 0; start < RAMSIZE; ){
+        long end = start;
+        while ((end < RAMSIZE) && loaded[end]){
+            end++;
+        }
+        if (end > start){
+            motherboard_write_ram(start, image + start, end - start);
+        }
+        start = end + 1;
+    }
+    if (options.entry >= 0){
+        cpu_state state;
+        cpu_get_state(&state);
+        state.PC = options.entry;
+        cpu_set_state(&state);
+    }
+    return 1;
+}
+
+
+
+// SIGHUP loads the files again at the end of the current slice
+static void loader_signal_handler(int signum){
+    ACTION[ACTION_LOAD] = 1;
+    terminal_notify();
+}
+
+
+
+void configure_loader(void){
+    if (options.load_count || (options.entry >= 0)){
+        if (!loader_load()){
+            exit(EXIT_FAILURE);
+        }
+        signal(SIGHUP, loader_signal_handler);
+    }
+}
@@ -16,6 +16,11 @@
 
 #include <stdint.h>
 #include <stdio.h> // printf
+#include "cpu6502.h"
+#include "hangdetect.h"
+#include "mc6850.h"
+#include "options.h"
+#include "probes.h"
 #include "terminal.h"
 
 // https://www.cpcwiki.eu/imgs/3/3f/MC6850.pdf
@@ -26,6 +31,14 @@ static uint8_t RDR; // Receive Data Register
 static uint8_t CR;  // Control Register
 static uint8_t SR;  // Status Register
 
+// The ROM waits for a key reading SR in a tight loop. After
+// IDLE_POLLS reads with no data, each less than IDLE_GAP cycles
+// apart, the computer is considered idle waiting for input
+#define IDLE_POLLS 16
+#define IDLE_GAP 64
+static uint64_t last_poll;
+static int empty_polls;
+
 
 
 void mc6850_reset(void){
@@ -33,6 +46,7 @@ void mc6850_reset(void){
     RDR = 0x00;
     CR = 0x00;
     SR = 0x0E;
+    empty_polls = 0;
 }
 
 
@@ -44,15 +58,49 @@ uint8_t mc6850_readbyte(uint16_t address){
         uint8_t data;
         switch (address & 0x0001){
             case 0: // SR
+                if (options.flag_keyboard){
+                    // Typing goes to the keyboard matrix
+                    data = SR;
+                    break;
+                }
                 if (check_keyboard_ready()){
                     SR |= 0x01;
+                    empty_polls = 0;
+                } else {
+                    uint64_t now = cpu_total_cycles();
+                    if (now - last_poll < IDLE_GAP){
+                        // Waiting for input is not hung
+                        empty_polls++;
+                        hang_io();
+                    } else {
+                        empty_polls = 0;
+                    }
+                    last_poll = now;
+                    if (empty_polls >= IDLE_POLLS){
+                        // Block instead of spinning if possible
+                        terminal_wait_input();
+                        if (check_keyboard_ready()){
+                            SR |= 0x01;
+                        }
+                        empty_polls = 0;
+                    }
                 }
                 data = SR;
                 break;
                 
             case 1: // RDR
+                if (options.flag_keyboard){
+                    data = RDR;
+                    break;
+                }
+                if (!check_keyboard_ready()){
+                    // Nothing to read yet
+                    terminal_wait_input();
+                }
                 RDR = read_keyboard();
+                hang_io();
                 data = RDR;
+                PROBE1(acia__rdr__read, data);
                 SR &= 0xFE; // Clear RDRF
                 break;
         }
@@ -65,6 +113,16 @@ uint8_t mc6850_readbyte(uint16_t address){
 
 
 
+// Clears RDRF when input was taken without reading
+// the RDR, like the ROM line input trap does
+void mc6850_input_taken(void){
+    if (!check_keyboard_ready()){
+        SR &= 0xFE;
+    }
+}
+
+
+
 // Writes a byte to the PIA
 void mc6850_writebyte(uint16_t address, uint8_t data){
     // Check for A11 = 0
@@ -75,7 +133,10 @@ void mc6850_writebyte(uint16_t address, uint8_t data){
                 break;
                 
             case 1: // TDR
+                PROBE1(acia__tdr__write, data);
                 write_terminal(data);
+                empty_polls = 0;
+                hang_io();
                 SR |= 0x02;
                 break;
         }
@@ -83,3 +144,22 @@ void mc6850_writebyte(uint16_t address, uint8_t data){
     // Writes with A11 = 1 are ignored
     // because ACIA is not selected
 }
+
+
+
+void mc6850_get_state(mc6850_state *state){
+    state->TDR = TDR;
+    state->RDR = RDR;
+    state->CR = CR;
+    state->SR = SR;
+}
+
+
+
+void mc6850_set_state(mc6850_state *state){
+    TDR = state->TDR;
+    RDR = state->RDR;
+    CR = state->CR;
+    SR = state->SR;
+    empty_polls = 0;
+}
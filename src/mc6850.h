@@ -17,7 +17,19 @@
 #ifndef mc6850_h
     #define mc6850_h
     #include <stdint.h>
+
+    // ACIA registers, for snapshots
+    typedef struct{
+        uint8_t TDR;
+        uint8_t RDR;
+        uint8_t CR;
+        uint8_t SR;
+    } mc6850_state;
+
     void mc6850_reset(void);
     uint8_t mc6850_readbyte(uint16_t address);
     void mc6850_writebyte(uint16_t address, uint8_t data);
+    void mc6850_input_taken(void);
+    void mc6850_get_state(mc6850_state *state);
+    void mc6850_set_state(mc6850_state *state);
 #endif
@@ -0,0 +1,129 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Metrics file for monitoring. Every second, and on exit, the
+// statistics kept by the slice loop are written in the text
+// format of Prometheus to a temporary file that is renamed
+// over the metrics file, so readers never see half of it
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+#include "options.h"
+#include "stats.h"
+#include "terminal.h"
+#include "timeutils.h"
+
+// Nanoseconds between writes
+#define METRICS_INTERVAL 1000000000L
+
+
+static struct timespec next_write;
+static struct timespec last_write;
+static uint64_t last_cycles = 0;
+static double mhz = 0;
+
+
+
+static void write_metric(FILE *f, const char *name, const char *type, const char *help, double value){
+    fprintf(f, "# HELP uk101re_%s %s\n", name, help);
+    fprintf(f, "# TYPE uk101re_%s %s\n", name, type);
+    fprintf(f, "uk101re_%s %.15g\n", name, value);
+}
+
+
+
+static void write_metrics(void){
+    struct timespec now, elapsed;
+    char *tempname = malloc(strlen(options.metrics) + 5);
+    sprintf(tempname, "%s.tmp", options.metrics);
+    
+    // Effective speed since the previous write, unless the
+    // last one was too recent to tell (like when exiting)
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timerspecsub(&now, &last_write, &elapsed);
+    if (timespec_to_ns(&elapsed) >= METRICS_INTERVAL / 10){
+        mhz = (double)(stats.cycles - last_cycles) * 1000 / timespec_to_ns(&elapsed);
+        last_write = now;
+        last_cycles = stats.cycles;
+    }
+    
+    // Errors are reported but never stop the emulator,
+    // and this also runs from an exit hook
+    FILE *f = fopen(tempname, "w");
+    if (f == NULL){
+        fprintf(stderr, "Error: can't create %s\n", tempname);
+        free(tempname);
+        return;
+    }
+    write_metric(f, "instructions_total", "counter", "Instructions executed.", stats.instructions);
+    write_metric(f, "cycles_total", "counter", "Emulated cycles executed.", stats.cycles);
+    write_metric(f, "effective_mhz", "gauge", "Emulated cycles per microsecond over the last second.", mhz);
+    write_metric(f, "slices_total", "counter", "Slices executed.", stats.slices);
+    write_metric(f, "slices_overrun_total", "counter", "Slices that took longer than real time.", stats.overruns);
+    write_metric(f, "acia_input_bytes_total", "counter", "Bytes read by the ACIA from the keyboard and datafiles.", stats.input_bytes + stats.datafile_bytes);
+    write_metric(f, "acia_output_bytes_total", "counter", "Bytes written by the ACIA.", stats.output_bytes);
+    write_metric(f, "input_queue_bytes", "gauge", "Bytes waiting to be read by the ACIA.", terminal_input_queued());
+    write_metric(f, "snapshots_saved_total", "counter", "Snapshots written.", stats.snapshots_saved);
+    write_metric(f, "snapshots_loaded_total", "counter", "Snapshots loaded.", stats.snapshots_loaded);
+    if (ferror(f) | fclose(f) || rename(tempname, options.metrics)){
+        fprintf(stderr, "Error: can't write %s\n", options.metrics);
+        remove(tempname);
+    }
+    free(tempname);
+}
+
+
+
+// Called at the end of every slice. Writes the
+// metrics file once the interval has elapsed
+void metrics_slice(void){
+    struct timespec now;
+    
+    if (options.metrics == NULL){
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec > next_write.tv_sec) ||
+        ((now.tv_sec == next_write.tv_sec) && (now.tv_nsec >= next_write.tv_nsec))){
+        write_metrics();
+        next_write = now;
+        timespec_add_ns(&next_write, METRICS_INTERVAL);
+    }
+}
+
+
+
+// Executed whenever the program exits
+static void metrics_hook(void){
+    write_metrics();
+}
+
+
+
+void configure_metrics(void){
+    if (options.metrics){
+        clock_gettime(CLOCK_MONOTONIC, &last_write);
+        next_write = last_write;
+        timespec_add_ns(&next_write, METRICS_INTERVAL);
+        atexit(metrics_hook);
+    }
+}
@@ -0,0 +1,295 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Live migration of the emulated computer to another emulator
+// process through a Unix socket. On SIGUSR2 all RAM is sent
+// while the computer keeps running, then at the end of every
+// slice the pages written since the previous round. When few
+// pages are left, or after too many rounds, the computer stops
+// to send the last pages and the devices state and quits.
+//
+// Stream format:
+//
+//   char[8]             "UK101MG" with the terminating zero
+//   'P', page, 256 bytes  A RAM page, repeated
+//   'S', devices state  The end of the migration (see snapshot.c)
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "migrate.h"
+#include "motherboard.h"
+#include "options.h"
+#include "snapshot.h"
+#include "terminal.h"
+#include "timeutils.h"
+
+#define MIGRATE_MAGIC "UK101MG"
+#define MIGRATE_PAGE 'P'
+#define MIGRATE_STATE 'S'
+
+// Stop the computer when this few pages are left to send,
+// or after this many rounds if it writes faster than that
+#define MIGRATE_FINAL_PAGES 8
+#define MIGRATE_MAX_ROUNDS 50
+
+
+static FILE *migration = NULL;
+static int rounds;
+static long pages_sent;
+
+
+
+// Write errors are found by flushing at the end of each round
+static void write_block(const void *data, size_t size){
+    fwrite(data, 1, size, migration);
+}
+
+
+
+// Gives up a migration that can't be sent, for example because
+// the other emulator died. This computer is the only copy left,
+// so it keeps running and can be migrated again later
+static void abort_migration(int close_stream){
+    fprintf(stderr, "\n*** Can't migrate to %s: %s ***\n", options.migrate_to, strerror(errno));
+    if (close_stream){
+        fclose(migration);
+    }
+    migration = NULL;
+    rounds = 0;
+    pages_sent = 0;
+}
+
+
+
+static void read_block(FILE *f, void *data, size_t size){
+    if (fread(data, 1, size, f) != size){
+        fprintf(stderr, "Error: bad migration from %s\n", options.migrate_from);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+static void unix_address(struct sockaddr_un *address, const char *path){
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)){
+        fprintf(stderr, "Error: socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address->sun_path, path);
+}
+
+
+
+// Sends the dirty pages and clears them. Returns how many,
+// or -1 if they couldn't be sent
+static int send_dirty_pages(void){
+    const uint8_t *ram = motherboard_ram();
+    uint8_t header[2];
+    int pages = 0;
+    
+    for (int page = 0; page < RAMPAGES; page++){
+        if (motherboard_page_dirty(page)){
+            header[0] = MIGRATE_PAGE;
+            header[1] = page;
+            write_block(header, sizeof(header));
+            write_block(ram + (page << 8), 256);
+            pages++;
+        }
+    }
+    motherboard_set_dirty(0);
+    if (fflush(migration) || ferror(migration)){
+        return -1;
+    }
+    pages_sent += pages;
+    return pages;
+}
+
+
+
+// Connects to the emulator waiting for the migration and
+// sends all RAM. The computer keeps running meanwhile
+void migrate_start(void){
+    struct sockaddr_un address;
+    int fd;
+    
+    if (migration){
+        return;
+    }
+    unix_address(&address, options.migrate_to);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || connect(fd, (struct sockaddr *)&address, sizeof(address))){
+        fprintf(stderr, "\n*** Can't migrate to %s ***\n", options.migrate_to);
+        if (fd >= 0){
+            close(fd);
+        }
+        return;
+    }
+    migration = fdopen(fd, "wb");
+    write_block(MIGRATE_MAGIC, sizeof(MIGRATE_MAGIC));
+    
+    // The first round sends all RAM
+    motherboard_set_dirty(1);
+    rounds = 0;
+    pages_sent = 0;
+    if (send_dirty_pages() < 0){
+        abort_migration(1);
+    }
+}
+
+
+
+// Called at the end of every slice. Sends the pages written
+// during the slice and finishes the migration when the rest
+// can be sent quickly. With the computer running as a
+// coroutine the slice may end in the middle of an instruction
+// waiting for input; then the computer is asked to finish
+// it first as for any other user action
+void migrate_step(void){
+    struct timespec start, stop, pause;
+    uint8_t type = MIGRATE_STATE;
+    int dirty = 0;
+    
+    if (!migration){
+        return;
+    }
+    for (int page = 0; page < RAMPAGES; page++){
+        dirty += motherboard_page_dirty(page);
+    }
+    rounds++;
+    if ((dirty > MIGRATE_FINAL_PAGES) && (rounds < MIGRATE_MAX_ROUNDS)){
+        if (send_dirty_pages() < 0){
+            abort_migration(1);
+        }
+        return;
+    }
+    if (terminal_waiting_input()){
+        // Wake the computer up now, not at the next timeout
+        ACTION[ACTION_MIGRATE] = 1;
+        terminal_notify();
+        return;
+    }
+    
+    // The computer is stopped from here on
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (send_dirty_pages() < 0){
+        abort_migration(1);
+        return;
+    }
+    write_block(&type, sizeof(type));
+    snapshot_write_devices(migration);
+    if (fflush(migration) || ferror(migration)){
+        abort_migration(1);
+        return;
+    }
+    if (fclose(migration)){
+        abort_migration(0);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    timerspecsub(&stop, &start, &pause);
+    
+    fprintf(stderr, "\n*** Migrated to %s: %d rounds, %ld pages, paused %ld us ***\n",
+        options.migrate_to, rounds, pages_sent, timespec_to_us(&pause));
+    exit(EXIT_MIGRATED);
+}
+
+
+
+// Waits for a migrating emulator and loads its RAM and
+// devices state. Pages come in until the state arrives
+static void migrate_receive(void){
+    struct sockaddr_un address;
+    uint8_t type, page;
+    static uint8_t data[256];
+    char magic[sizeof(MIGRATE_MAGIC)];
+    int listener, fd;
+    FILE *f;
+    
+    unix_address(&address, options.migrate_from);
+    unlink(options.migrate_from);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((listener < 0) ||
+        bind(listener, (struct sockaddr *)&address, sizeof(address)) ||
+        listen(listener, 1)){
+        fprintf(stderr, "Error: can't listen on %s\n", options.migrate_from);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Waiting for a migration on %s\n", options.migrate_from);
+    fd = accept(listener, NULL, NULL);
+    close(listener);
+    unlink(options.migrate_from);
+    if (fd < 0){
+        perror("Error: can't accept migration");
+        exit(EXIT_FAILURE);
+    }
+    
+    f = fdopen(fd, "rb");
+    read_block(f, magic, sizeof(magic));
+    if (memcmp(magic, MIGRATE_MAGIC, sizeof(magic))){
+        fprintf(stderr, "Error: bad migration from %s\n", options.migrate_from);
+        exit(EXIT_FAILURE);
+    }
+    while (1){
+        read_block(f, &type, sizeof(type));
+        if (type == MIGRATE_STATE){
+            break;
+        }
+        if (type != MIGRATE_PAGE){
+            fprintf(stderr, "Error: bad migration from %s\n", options.migrate_from);
+            exit(EXIT_FAILURE);
+        }
+        read_block(f, &page, sizeof(page));
+        read_block(f, data, sizeof(data));
+        motherboard_write_ram(page << 8, data, sizeof(data));
+    }
+    snapshot_read_devices(f, options.migrate_from);
+    fclose(f);
+    fprintf(stderr, "*** Migrated from %s ***\n", options.migrate_from);
+}
+
+
+
+// SIGUSR2 starts a migration at the end of the current slice
+static void migrate_signal_handler(int signum){
+    ACTION[ACTION_MIGRATE] = 1;
+    terminal_notify();
+}
+
+
+
+void configure_migration(void){
+    if (options.migrate_from){
+        migrate_receive();
+    }
+    if (options.migrate_to){
+        // Checked now so a long path doesn't stop a migration
+        struct sockaddr_un address;
+        unix_address(&address, options.migrate_to);
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGUSR2, migrate_signal_handler);
+    }
+}
@@ -17,10 +17,19 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cpu6502.h"
+#include "dma.h"
+#include "fpu.h"
+#include "hangdetect.h"
+#include "keyboard.h"
 #include "mc6850.h"
+#include "motherboard.h"
 #include "options.h"
+#include "profile.h"
+#include "serial.h"
+#include "video.h"
 
 // 32 kB ROM
 #define ROMSIZE 0x8000
@@ -28,10 +37,11 @@
 static uint8_t ROM[ROMSIZE];
 
 // 32k kB RAM
-#define RAMSIZE 0x8000
-#define RAMMASK 0x7FFF
 static uint8_t RAM[RAMSIZE];
 
+// Pages (256 bytes) written since last cleared
+static uint8_t DIRTY[RAMPAGES];
+
 
 
 static void load_rom(uint8_t* dest, long romsize, char* romfilename){
@@ -90,7 +100,11 @@ static uint8_t ram_readbyte(uint16_t address){
 
 // RAM write: write the byte requested with the new value
 static void ram_writebyte(uint16_t address, uint8_t data){
+    if (options.flag_hang_detect){
+        hang_ram_write(address & RAMMASK, RAM[address & RAMMASK], data);
+    }
     RAM[address & RAMMASK] = data;
+    DIRTY[(address & RAMMASK) >> 8] = 1;
 }
 
 
@@ -111,6 +125,18 @@ void motherboard_reset(void){
     // Resets ACIA
     mc6850_reset();
     
+    // Resets DMA controller
+    dma_reset();
+    
+    // Resets floating point coprocessor
+    fpu_reset();
+    
+    // Resets second serial channel
+    serial_reset();
+    
+    // Releases all keys
+    keyboard_reset();
+    
     // Resets CPU
     cpu_reset();
     
@@ -122,6 +148,8 @@ void motherboard_reset(void){
 // NOTE: This kind of switch-case with built-in
 // ranges is an extension of GCC and Clang/LLVM
 uint8_t motherboard_readbyte(uint16_t address){ 
+    PROFILE_READ(address);
+    
     // This switch-case implements the address decoding
     switch (address){
         case 0x0000 ... 0x7FFF :
@@ -129,10 +157,25 @@ uint8_t motherboard_readbyte(uint16_t address){
             break;
 
         case 0x8000 ... 0xEFFF :
+            if (options.video && (address >= VIDEO_BASE) && (address <= VIDEO_END)){
+                return video_readbyte(address);
+            }
+            if (options.flag_keyboard && (address >= KEYBOARD_BASE) && (address <= KEYBOARD_END)){
+                return keyboard_readbyte(address);
+            }
             return rom_readbyte(address);
             break;
                                  
         case 0xF000 ... 0xF7FF : 
+            if (options.flag_dma && (address >= DMA_BASE) && (address <= DMA_END)){
+                return dma_readbyte(address);
+            }
+            if (options.flag_fpu && (address >= FPU_BASE) && (address <= FPU_END)){
+                return fpu_readbyte(address);
+            }
+            if (options.flag_serial && (address >= SERIAL_BASE) && (address <= SERIAL_END)){
+                return serial_readbyte(address);
+            }
             return mc6850_readbyte(address);
             break;
             
@@ -151,6 +194,8 @@ uint8_t motherboard_readbyte(uint16_t address){
 
 
 void motherboard_writebyte(uint16_t address, uint8_t data){
+    PROFILE_WRITE(address);
+    
     // This switch-case implements the address decoding
     switch (address){
         case 0x0000 ... 0x7FFF : 
@@ -158,10 +203,25 @@ void motherboard_writebyte(uint16_t address, uint8_t data){
             break;
                                 
         case 0x8000 ... 0xEFFF :
+            if (options.video && (address >= VIDEO_BASE) && (address <= VIDEO_END)){
+                return video_writebyte(address, data);
+            }
+            if (options.flag_keyboard && (address >= KEYBOARD_BASE) && (address <= KEYBOARD_END)){
+                return keyboard_writebyte(address, data);
+            }
             return rom_writebyte(address, data);
             break;
                                  
         case 0xF000 ... 0xF7FF : 
+            if (options.flag_dma && (address >= DMA_BASE) && (address <= DMA_END)){
+                return dma_writebyte(address, data);
+            }
+            if (options.flag_fpu && (address >= FPU_BASE) && (address <= FPU_END)){
+                return fpu_writebyte(address, data);
+            }
+            if (options.flag_serial && (address >= SERIAL_BASE) && (address <= SERIAL_END)){
+                return serial_writebyte(address, data);
+            }
             return mc6850_writebyte(address, data);
             break;
             
@@ -175,5 +235,75 @@ void motherboard_writebyte(uint16_t address, uint8_t data){
             break;
     }
 }
-            
 
+
+
+// Direct access to the RAM, read only
+const uint8_t *motherboard_ram(void){
+    return RAM;
+}
+
+
+
+// Writes a block of bytes into RAM, wrapping around
+// at the end, the same way the CPU would do it
+void motherboard_write_ram(uint16_t address, const uint8_t *data, long length){
+    for (long i = 0; i < length; i++){
+        ram_writebyte(address + i, data[i]);
+    }
+}
+
+
+
+// FNV-1a hash of the ROM, to tell ROM images apart
+uint64_t motherboard_rom_hash(void){
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (long i = 0; i < ROMSIZE; i++){
+        hash ^= ROM[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+
+
+uint8_t motherboard_page_dirty(int page){
+    return DIRTY[page];
+}
+
+
+
+// Marks all RAM pages as dirty or clean
+void motherboard_set_dirty(uint8_t dirty){
+    memset(DIRTY, dirty, sizeof(DIRTY));
+}
+
+
+
+// Returns whether an address is decoded to the ROM
+uint8_t motherboard_is_rom(uint16_t address){
+    if (options.video && (address >= VIDEO_BASE) && (address <= VIDEO_END)){
+        return 0;
+    }
+    if (options.flag_keyboard && (address >= KEYBOARD_BASE) && (address <= KEYBOARD_END)){
+        return 0;
+    }
+    return ((address >= 0x8000) && (address <= 0xEFFF)) || (address >= 0xF800);
+}
+
+
+
+// Reads a byte without side effects, for tools that inspect
+// memory. Devices read as 0xFF, except video RAM
+uint8_t motherboard_peek(uint16_t address){
+    if (address <= 0x7FFF){
+        return ram_readbyte(address);
+    }
+    if (options.video && (address >= VIDEO_BASE) && (address <= VIDEO_END)){
+        return video_readbyte(address);
+    }
+    if (motherboard_is_rom(address)){
+        return rom_readbyte(address);
+    }
+    return 0xFF;
+}
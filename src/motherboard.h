@@ -17,8 +17,21 @@
 #ifndef motherboard_h
     #define motherboard_h
     #include <stdint.h>
+
+    // 32 kB RAM
+    #define RAMSIZE 0x8000
+    #define RAMMASK 0x7FFF
+    #define RAMPAGES (RAMSIZE >> 8)
+
     void motherboard_init(void);
     void motherboard_reset(void);
     uint8_t motherboard_readbyte(uint16_t address);
     void motherboard_writebyte(uint16_t address, uint8_t data);
+    const uint8_t *motherboard_ram(void);
+    void motherboard_write_ram(uint16_t address, const uint8_t *data, long length);
+    uint64_t motherboard_rom_hash(void);
+    uint8_t motherboard_page_dirty(int page);
+    void motherboard_set_dirty(uint8_t dirty);
+    uint8_t motherboard_is_rom(uint16_t address);
+    uint8_t motherboard_peek(uint16_t address);
 #endif 
@@ -18,11 +18,51 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "dma.h"
+#include "fpu.h"
 #include "options.h"
+#include "serial.h"
+#include "video.h"
 
 uk101re_options options;
 
+// Values for long options without short version
+enum {
+    OPT_MAX_CYCLES = 256,
+    OPT_MAX_OUTPUT,
+    OPT_MAX_TIME,
+    OPT_MAX_IDLE,
+    OPT_MAX_INSTRUCTIONS,
+    OPT_CHECKPOINT,
+    OPT_RESUME,
+    OPT_MIGRATE_TO,
+    OPT_MIGRATE_FROM,
+    OPT_PROFILE,
+    OPT_METRICS,
+    OPT_SYMBOLS,
+    OPT_DISASSEMBLE,
+    OPT_TRAP_OUTPUT,
+    OPT_TRAP_INPUT,
+    OPT_LOAD,
+    OPT_ENTRY,
+    OPT_DUMP,
+    OPT_DUMP_CYCLES,
+    OPT_DUMP_MARKER,
+    OPT_HYPERCALL,
+    OPT_HYPERCALL_DIR,
+    OPT_DMA,
+    OPT_DMA_CYCLES,
+    OPT_DMA_DIR,
+    OPT_FPU,
+    OPT_FPU_PATCH,
+    OPT_SERIAL_IN,
+    OPT_SERIAL_OUT,
+    OPT_VIDEO,
+    OPT_KEYBOARD
+};
+
 
 
 static void show_banner(FILE *f){
@@ -40,23 +80,183 @@ static void show_help(FILE *f){
     fprintf(f, "\n");
     fprintf(f, "Options:\n");
     fprintf(f, "\n");
+    fprintf(f, "  -c cpu,     --cpu cpu       Pin emulation to a CPU.\n");
+    fprintf(f, "  -C,         --coroutine     Sleep while waiting for input.\n");
     fprintf(f, "  -h,         --help          Show this help.\n");
+    fprintf(f, "  -H,         --hang-detect   Quit when the program hangs.\n");
     fprintf(f, "  -v,         --version       Show UK101RE version.\n");
     fprintf(f, "  -t,         --turbo         Enable turbo mode.\n");
+    fprintf(f, "  -T,         --throttle      Skip output the terminal can't keep up with in turbo mode.\n");
+    fprintf(f, "  -l logfile, --log logfile   Write all output to a file.\n");
     fprintf(f, "  -r romfile, --rom romfile   Specify ROM file.\n");
+    fprintf(f, "  -R,         --realtime      Request real-time scheduling.\n");
+    fprintf(f, "  -s,         --stats         Show statistics on exit.\n");
+    fprintf(f, "              --load file[,address]\n");
+    fprintf(f, "                              Load a binary, Intel HEX or S-record file into RAM.\n");
+    fprintf(f, "              --entry address Start running at an address.\n");
+    fprintf(f, "              --dump file,start,end\n");
+    fprintf(f, "                              Write memory to a binary or Intel HEX file on exit.\n");
+    fprintf(f, "              --dump-cycles n Write the dumps after n cycles instead.\n");
+    fprintf(f, "              --dump-marker text\n");
+    fprintf(f, "                              Write the dumps whenever text is printed instead.\n");
+    fprintf(f, "              --hypercall     Make opcode 0x02 call host services.\n");
+    fprintf(f, "              --hypercall-dir dir\n");
+    fprintf(f, "                              Let hypercalls read and write files in dir.\n");
+    fprintf(f, "              --dma           Add a DMA controller at $%04X.\n", DMA_BASE);
+    fprintf(f, "              --dma-cycles n  Make DMA transfers take n cycles per byte (default %d).\n", DMA_DEFAULT_CYCLES);
+    fprintf(f, "              --dma-dir dir   Let DMA transfers read and write files in dir.\n");
+    fprintf(f, "              --fpu           Add a floating point coprocessor at $%04X.\n", FPU_BASE);
+    fprintf(f, "              --fpu-patch file\n");
+    fprintf(f, "                              Route the BASIC routines listed in file through it.\n");
+    fprintf(f, "              --serial-in file\n");
+    fprintf(f, "                              Feed a second ACIA at $%04X from a file, FIFO or socket.\n", SERIAL_BASE);
+    fprintf(f, "              --serial-out file\n");
+    fprintf(f, "                              Send the second ACIA output to a file, FIFO or socket.\n");
+    fprintf(f, "              --video kb      Map 1 or 2 kB of video RAM at $%04X and show it.\n", VIDEO_BASE);
+    fprintf(f, "              --keyboard      Type on the keyboard matrix at $DF00, not the ACIA.\n");
+    fprintf(f, "              --symbols file  Load ROM symbols.\n");
+    fprintf(f, "              --disassemble file\n");
+    fprintf(f, "                              Write a ROM disassembly and quit.\n");
+    fprintf(f, "              --checkpoint file\n");
+    fprintf(f, "                              Save a snapshot on SIGTERM/SIGINT and quit.\n");
+    fprintf(f, "              --resume file   Continue from a snapshot.\n");
+    fprintf(f, "              --profile file  Write a memory access profile on exit.\n");
+    fprintf(f, "              --metrics file  Write metrics for Prometheus every second.\n");
+    fprintf(f, "              --migrate-to socket\n");
+    fprintf(f, "                              Migrate to another emulator on SIGUSR2 and quit.\n");
+    fprintf(f, "              --migrate-from socket\n");
+    fprintf(f, "                              Wait for a migrating emulator and continue it.\n");
+    fprintf(f, "\n");
+    fprintf(f, "ROM traps (cycles charged default to %d):\n", TRAP_DEFAULT_CYCLES);
+    fprintf(f, "\n");
+    fprintf(f, "              --trap-output address[,cycles]\n");
+    fprintf(f, "                              Print characters sent to the ROM output routine.\n");
+    fprintf(f, "              --trap-input address,buffer[,cycles]\n");
+    fprintf(f, "                              Copy whole datafile lines into the BASIC input buffer.\n");
+    fprintf(f, "\n");
+    fprintf(f, "Limits (exit codes 4 to 8 when reached):\n");
+    fprintf(f, "\n");
+    fprintf(f, "              --max-cycles n  Quit after n emulated cycles.\n");
+    fprintf(f, "              --max-instructions n\n");
+    fprintf(f, "                              Quit after n instructions.\n");
+    fprintf(f, "              --max-output n  Quit after printing more than n bytes.\n");
+    fprintf(f, "              --max-time s    Quit after s seconds.\n");
+    fprintf(f, "              --max-idle s    Quit after waiting for input s seconds.\n");
     fprintf(f, "\n");
     fprintf(f, "Keyboard shortcuts:\n");
     fprintf(f, "\n");
     fprintf(f, "  Ctrl-C      Quits emulator.\n");
     fprintf(f, "  Ctrl-R      Resets 6502 CPU.\n");
+    fprintf(f, "  Ctrl-W      Writes memory dumps.\n");
     fprintf(f, "\n");
 }
 
 
 
+// Parses a non negative decimal number for an option
+static long parse_number(char *arg, const char *option){
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if ((*arg == 0) || (*end != 0) || (value < 0)){
+        fprintf(stderr, "Error: bad number for option %s: %s\n\n", option, arg);
+        show_banner(stderr);
+        show_help(stderr);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+
+
+// Parses an hexadecimal address for an option
+static long parse_address(char *arg, const char *option){
+    char *end;
+    long value = strtol(arg, &end, 16);
+    if ((*arg == 0) || (*end != 0) || (value < 0) || (value > 0xFFFF)){
+        fprintf(stderr, "Error: bad address for option %s: %s\n\n", option, arg);
+        show_banner(stderr);
+        show_help(stderr);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+
+
+// Parses hexadecimal addresses separated by commas. Returns
+// what follows them after a comma, or NULL if nothing does
+static char *parse_addresses(char *arg, const char *option, long *addresses, int count){
+    char *p = arg, *end;
+    for (int i = 0; i < count; i++){
+        addresses[i] = strtol(p, &end, 16);
+        if ((end == p) || (addresses[i] < 0) || (addresses[i] > 0xFFFF) ||
+            ((*end != ',') && ((*end != 0) || (i < count - 1)))){
+            fprintf(stderr, "Error: bad address for option %s: %s\n\n", option, arg);
+            show_banner(stderr);
+            show_help(stderr);
+            exit(EXIT_FAILURE);
+        }
+        p = end + 1;
+    }
+    return (*end == ',') ? p : NULL;
+}
+
+
+
+// Parses a trap option: addresses and, optionally,
+// the cycles charged for the routine
+static void parse_trap(char *arg, const char *option, long *addresses, int count, long *cycles){
+    char *rest = parse_addresses(arg, option, addresses, count);
+    *cycles = rest ? parse_number(rest, option) : TRAP_DEFAULT_CYCLES;
+}
+
+
+
 static void set_default_options(void){
     options.flag_help = 0;
     options.flag_turbo = 0;
+    options.flag_stats = 0;
+    options.flag_realtime = 0;
+    options.flag_throttle = 0;
+    options.flag_coroutine = 0;
+    options.flag_hang_detect = 0;
+    options.flag_hypercall = 0;
+    options.flag_dma = 0;
+    options.flag_fpu = 0;
+    options.flag_serial = 0;
+    options.flag_keyboard = 0;
+    options.logfile = NULL;
+    options.checkpoint = NULL;
+    options.resume = NULL;
+    options.migrate_to = NULL;
+    options.migrate_from = NULL;
+    options.profile = NULL;
+    options.metrics = NULL;
+    options.symbols = NULL;
+    options.disassemble = NULL;
+    options.trap_output = -1;
+    options.trap_output_cycles = TRAP_DEFAULT_CYCLES;
+    options.trap_input = -1;
+    options.trap_input_buffer = 0;
+    options.trap_input_cycles = TRAP_DEFAULT_CYCLES;
+    options.load_count = 0;
+    options.entry = -1;
+    options.dump_count = 0;
+    options.dump_cycles = 0;
+    options.dump_marker = NULL;
+    options.hypercall_dir = NULL;
+    options.dma_cycles = DMA_DEFAULT_CYCLES;
+    options.dma_dir = NULL;
+    options.fpu_patch = NULL;
+    options.serial_in = NULL;
+    options.serial_out = NULL;
+    options.video = 0;
+    options.cpu = -1;
+    options.max_cycles = 0;
+    options.max_instructions = 0;
+    options.max_output = 0;
+    options.max_time = 0;
+    options.max_idle = 0;
     options.flag_datafile = 0;
     options.datafile = NULL;
     options.romfile = "all.rom";
@@ -66,6 +266,8 @@ static void set_default_options(void){
 
 void parse_options(int argc, char *argv[]){
     int ch;
+    long trap[2];
+    char *separator;
     opterr = 0;  // We handle getopt errors
     
     struct option long_options[] = {
@@ -73,33 +275,263 @@ void parse_options(int argc, char *argv[]){
         {"version", no_argument, NULL, 'v'},
         {"turbo", no_argument, NULL, 't'},
         {"rom", required_argument, NULL, 'r'},
+        {"stats", no_argument, NULL, 's'},
+        {"cpu", required_argument, NULL, 'c'},
+        {"realtime", no_argument, NULL, 'R'},
+        {"throttle", no_argument, NULL, 'T'},
+        {"log", required_argument, NULL, 'l'},
+        {"coroutine", no_argument, NULL, 'C'},
+        {"hang-detect", no_argument, NULL, 'H'},
+        {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+        {"resume", required_argument, NULL, OPT_RESUME},
+        {"migrate-to", required_argument, NULL, OPT_MIGRATE_TO},
+        {"migrate-from", required_argument, NULL, OPT_MIGRATE_FROM},
+        {"profile", required_argument, NULL, OPT_PROFILE},
+        {"metrics", required_argument, NULL, OPT_METRICS},
+        {"symbols", required_argument, NULL, OPT_SYMBOLS},
+        {"disassemble", required_argument, NULL, OPT_DISASSEMBLE},
+        {"trap-output", required_argument, NULL, OPT_TRAP_OUTPUT},
+        {"trap-input", required_argument, NULL, OPT_TRAP_INPUT},
+        {"load", required_argument, NULL, OPT_LOAD},
+        {"entry", required_argument, NULL, OPT_ENTRY},
+        {"dump", required_argument, NULL, OPT_DUMP},
+        {"dump-cycles", required_argument, NULL, OPT_DUMP_CYCLES},
+        {"dump-marker", required_argument, NULL, OPT_DUMP_MARKER},
+        {"hypercall", no_argument, NULL, OPT_HYPERCALL},
+        {"hypercall-dir", required_argument, NULL, OPT_HYPERCALL_DIR},
+        {"dma", no_argument, NULL, OPT_DMA},
+        {"dma-cycles", required_argument, NULL, OPT_DMA_CYCLES},
+        {"dma-dir", required_argument, NULL, OPT_DMA_DIR},
+        {"fpu", no_argument, NULL, OPT_FPU},
+        {"fpu-patch", required_argument, NULL, OPT_FPU_PATCH},
+        {"serial-in", required_argument, NULL, OPT_SERIAL_IN},
+        {"serial-out", required_argument, NULL, OPT_SERIAL_OUT},
+        {"video", required_argument, NULL, OPT_VIDEO},
+        {"keyboard", no_argument, NULL, OPT_KEYBOARD},
+        {"max-cycles", required_argument, NULL, OPT_MAX_CYCLES},
+        {"max-instructions", required_argument, NULL, OPT_MAX_INSTRUCTIONS},
+        {"max-output", required_argument, NULL, OPT_MAX_OUTPUT},
+        {"max-time", required_argument, NULL, OPT_MAX_TIME},
+        {"max-idle", required_argument, NULL, OPT_MAX_IDLE},
         {0, 0, 0, 0}
     };
     
     set_default_options();
     
-    while ((ch = getopt_long(argc, argv, ":hvtr:", long_options, NULL)) != -1) {
+    while ((ch = getopt_long(argc, argv, ":hvtr:sc:RTl:CH", long_options, NULL)) != -1) {
         switch (ch) {
+            case 'c':
+                options.cpu = parse_number(optarg, "--cpu");
+                break;
+
+            case 'C':
+                options.flag_coroutine = 1;
+                break;
+
             case 'h':
                 show_help(stdout);
                 exit(EXIT_SUCCESS);
                 break;
                 
+            case 'H':
+                options.flag_hang_detect = 1;
+                break;
+
+            case 'l':
+                options.logfile = optarg;
+                break;
+
             case 'r':
                 options.romfile = optarg;
                 break;
 
+            case 'R':
+                options.flag_realtime = 1;
+                break;
+
+            case 's':
+                options.flag_stats = 1;
+                break;
+
             case 't':
                 options.flag_turbo = 1;
                 break;
+
+            case 'T':
+                options.flag_throttle = 1;
+                break;
                 
             case 'v':
                 show_banner(stdout);
                 exit(EXIT_SUCCESS);
                 break;
 
+            case OPT_CHECKPOINT:
+                options.checkpoint = optarg;
+                break;
+
+            case OPT_RESUME:
+                options.resume = optarg;
+                break;
+
+            case OPT_MIGRATE_TO:
+                options.migrate_to = optarg;
+                break;
+
+            case OPT_MIGRATE_FROM:
+                options.migrate_from = optarg;
+                break;
+
+            case OPT_PROFILE:
+                options.profile = optarg;
+                break;
+
+            case OPT_METRICS:
+                options.metrics = optarg;
+                break;
+
+            case OPT_SYMBOLS:
+                options.symbols = optarg;
+                break;
+
+            case OPT_DISASSEMBLE:
+                options.disassemble = optarg;
+                break;
+
+            case OPT_TRAP_OUTPUT:
+                parse_trap(optarg, "--trap-output", &options.trap_output, 1, &options.trap_output_cycles);
+                break;
+
+            case OPT_TRAP_INPUT:
+                parse_trap(optarg, "--trap-input", trap, 2, &options.trap_input_cycles);
+                options.trap_input = trap[0];
+                options.trap_input_buffer = trap[1];
+                break;
+
+            case OPT_LOAD:
+                if (options.load_count == LOAD_MAX){
+                    fprintf(stderr, "Error: too many files to load\n");
+                    exit(EXIT_FAILURE);
+                }
+                options.load[options.load_count] = optarg;
+                options.load_address[options.load_count] = -1;
+                separator = strrchr(optarg, ',');
+                if (separator){
+                    *separator = 0;
+                    options.load_address[options.load_count] = parse_address(separator + 1, "--load");
+                }
+                options.load_count++;
+                break;
+
+            case OPT_ENTRY:
+                options.entry = parse_address(optarg, "--entry");
+                break;
+
+            case OPT_DUMP:
+                if (options.dump_count == DUMP_MAX){
+                    fprintf(stderr, "Error: too many memory dumps\n");
+                    exit(EXIT_FAILURE);
+                }
+                separator = strchr(optarg, ',');
+                if (separator == NULL){
+                    fprintf(stderr, "Error: missing address range for option --dump: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                *separator = 0;
+                options.dump[options.dump_count] = optarg;
+                if (parse_addresses(separator + 1, "--dump", trap, 2) || (trap[1] < trap[0])){
+                    fprintf(stderr, "Error: bad address range for option --dump: %s\n", separator + 1);
+                    exit(EXIT_FAILURE);
+                }
+                options.dump_start[options.dump_count] = trap[0];
+                options.dump_end[options.dump_count] = trap[1];
+                options.dump_count++;
+                break;
+
+            case OPT_DUMP_CYCLES:
+                options.dump_cycles = parse_number(optarg, "--dump-cycles");
+                break;
+
+            case OPT_DUMP_MARKER:
+                options.dump_marker = optarg;
+                break;
+
+            case OPT_HYPERCALL:
+                options.flag_hypercall = 1;
+                break;
+
+            case OPT_HYPERCALL_DIR:
+                options.flag_hypercall = 1;
+                options.hypercall_dir = optarg;
+                break;
+
+            case OPT_DMA:
+                options.flag_dma = 1;
+                break;
+
+            case OPT_DMA_CYCLES:
+                options.flag_dma = 1;
+                options.dma_cycles = parse_number(optarg, "--dma-cycles");
+                break;
+
+            case OPT_DMA_DIR:
+                options.flag_dma = 1;
+                options.dma_dir = optarg;
+                break;
+
+            case OPT_FPU:
+                options.flag_fpu = 1;
+                break;
+
+            case OPT_FPU_PATCH:
+                options.flag_fpu = 1;
+                options.fpu_patch = optarg;
+                break;
+
+            case OPT_SERIAL_IN:
+                options.flag_serial = 1;
+                options.serial_in = optarg;
+                break;
+
+            case OPT_SERIAL_OUT:
+                options.flag_serial = 1;
+                options.serial_out = optarg;
+                break;
+
+            case OPT_VIDEO:
+                options.video = parse_number(optarg, "--video");
+                if ((options.video != 1) && (options.video != 2)){
+                    fprintf(stderr, "Error: video RAM must be 1 or 2 kB\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_KEYBOARD:
+                options.flag_keyboard = 1;
+                break;
+
+            case OPT_MAX_CYCLES:
+                options.max_cycles = parse_number(optarg, "--max-cycles");
+                break;
+
+            case OPT_MAX_INSTRUCTIONS:
+                options.max_instructions = parse_number(optarg, "--max-instructions");
+                break;
+
+            case OPT_MAX_OUTPUT:
+                options.max_output = parse_number(optarg, "--max-output");
+                break;
+
+            case OPT_MAX_TIME:
+                options.max_time = parse_number(optarg, "--max-time");
+                break;
+
+            case OPT_MAX_IDLE:
+                options.max_idle = parse_number(optarg, "--max-idle");
+                break;
+
             case ':':
-                fprintf(stderr, "Error: option %c needs an argument\n\n", optopt);
+                fprintf(stderr, "Error: option %s needs an argument\n\n", argv[optind - 1]);
                 show_banner(stderr);
                 show_help(stderr);
                 exit(EXIT_FAILURE);
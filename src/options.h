@@ -18,12 +18,69 @@
     #define options_h
     #include <stdint.h>
 
+    // Cycles charged for a trapped ROM routine, unless told
+    // otherwise. About what a short output routine takes
+    #define TRAP_DEFAULT_CYCLES 40
+
+    // Files that can be loaded into RAM
+    #define LOAD_MAX 8
+
+    // Memory ranges that can be dumped
+    #define DUMP_MAX 8
+
     typedef struct{
         uint16_t flag_help;
         uint8_t flag_turbo;
+        uint8_t flag_stats;
+        uint8_t flag_realtime;
+        uint8_t flag_throttle;
+        uint8_t flag_coroutine;
+        uint8_t flag_hang_detect;
+        uint8_t flag_hypercall;
+        uint8_t flag_dma;
+        uint8_t flag_fpu;
+        uint8_t flag_serial;
+        uint8_t flag_keyboard;
+        int cpu;
+        uint64_t max_cycles;
+        uint64_t max_instructions;
+        uint64_t max_output;
+        long max_time;
+        long max_idle;
         uint8_t flag_datafile;
         char *datafile;
         char *romfile;
+        char *logfile;
+        char *checkpoint;
+        char *migrate_to;
+        char *migrate_from;
+        char *profile;
+        char *metrics;
+        char *symbols;
+        char *disassemble;
+        long trap_output;       // Address, -1 for none
+        long trap_output_cycles;
+        long trap_input;        // Address, -1 for none
+        long trap_input_buffer;
+        long trap_input_cycles;
+        char *load[LOAD_MAX];
+        long load_address[LOAD_MAX]; // -1 if not given
+        int load_count;
+        long entry;             // Initial PC, -1 for the reset vector
+        char *dump[DUMP_MAX];
+        long dump_start[DUMP_MAX];
+        long dump_end[DUMP_MAX];
+        int dump_count;
+        uint64_t dump_cycles;
+        char *dump_marker;
+        char *hypercall_dir;
+        long dma_cycles;        // Per byte transferred
+        char *dma_dir;
+        char *fpu_patch;
+        char *serial_in;
+        char *serial_out;
+        int video;              // Video RAM in kB, 0 for none
+        char *resume;
     } uk101re_options;
 
     extern uk101re_options options;
@@ -0,0 +1,258 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/timerfd.h>
+#else
+    #include <poll.h>
+#endif
+
+#include "pacer.h"
+#include "stats.h"
+#include "timeutils.h"
+
+// A machine that gets this late (in ns) does not try
+// to catch up, it just keeps running from now on
+#define MAX_LATENESS 20000000L
+
+// Blocked machines still run once per second
+// so they can check their time limits
+#define BLOCKED_WAKEUP 1000000000L
+
+static machine *machines[PACER_MAX_MACHINES];
+static int machine_count = 0;
+
+#ifdef __linux__
+    static int epoll_fd = -1;
+    static int timer_fd = -1;
+#endif
+
+
+
+// Returns 1 if a is earlier than b
+static int before(struct timespec *a, struct timespec *b){
+    if (a->tv_sec != b->tv_sec){
+        return a->tv_sec < b->tv_sec;
+    }
+    return a->tv_nsec < b->tv_nsec;
+}
+
+
+
+// Reads everything pending in an event file descriptor
+static void drain(int fd){
+    uint8_t buffer[64];
+    while (read(fd, buffer, sizeof(buffer)) > 0);
+}
+
+
+
+void pacer_add(machine *m){
+    if (machine_count == PACER_MAX_MACHINES){
+        fprintf(stderr, "Error: too many machines\n");
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &m->next);
+    m->woken = 0;
+    m->blocked = 0;
+    machines[machine_count++] = m;
+}
+
+
+
+// Runs a slice of a machine and computes when the next
+// one is due: each cycle at 1.000 MHz is 1 us
+static void run_machine(machine *m){
+    struct timespec now, elapsed;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (m->paced && !before(&now, &m->next)){
+        timerspecsub(&now, &m->next, &elapsed);
+        long lateness = timespec_to_ns(&elapsed);
+        histogram_record(&stats.lateness, lateness);
+        if (lateness > MAX_LATENESS){
+            m->next = now;
+        }
+    }
+    
+    long cycles = m->run_slice(m);
+    
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (m->blocked){
+        m->next = end;
+        timespec_add_ns(&m->next, BLOCKED_WAKEUP);
+    } else if (m->paced){
+        timespec_add_ns(&m->next, cycles * 1000L);
+        if (before(&m->next, &end)){
+            stats.overruns++;
+        } else {
+            stats.sleeps++;
+        }
+    } else {
+        m->next = end;
+    }
+}
+
+
+
+#ifdef __linux__
+
+// A single timerfd, armed for the earliest deadline, paces
+// all the machines. Their event fds share the same epoll set
+static void setup_events(void){
+    struct epoll_event event;
+    
+    epoll_fd = epoll_create1(0);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if ((epoll_fd < 0) || (timer_fd < 0)){
+        perror("Error: can't setup pacing timer");
+        exit(EXIT_FAILURE);
+    }
+    
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+    
+    for (int i = 0; i < machine_count; i++){
+        if (machines[i]->event_fd >= 0){
+            event.events = EPOLLIN;
+            event.data.ptr = machines[i];
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, machines[i]->event_fd, &event);
+        }
+    }
+}
+
+
+
+// Waits until the wakeup time or until a machine gets input
+static void wait_events(struct timespec *wakeup, int busy){
+    struct epoll_event events[16];
+    struct itimerspec timer = {0};
+    
+    if (wakeup){
+        timer.it_value = *wakeup;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+    
+    int n = epoll_wait(epoll_fd, events, 16, busy ? 0 : -1);
+    for (int i = 0; i < n; i++){
+        machine *m = events[i].data.ptr;
+        if (m){
+            drain(m->event_fd);
+            m->woken = 1;
+        } else {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) < 0){
+                // Nothing to do. The timer was rearmed
+            }
+        }
+    }
+}
+
+#else
+
+static void setup_events(void){
+}
+
+
+
+// Same as above, using poll() for systems without timerfd
+static void wait_events(struct timespec *wakeup, int busy){
+    struct pollfd fds[PACER_MAX_MACHINES];
+    machine *owners[PACER_MAX_MACHINES];
+    int nfds = 0;
+    int timeout = -1;
+    
+    for (int i = 0; i < machine_count; i++){
+        if (machines[i]->event_fd >= 0){
+            fds[nfds].fd = machines[i]->event_fd;
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = machines[i];
+        }
+    }
+    
+    if (busy){
+        timeout = 0;
+    } else if (wakeup){
+        struct timespec now, elapsed;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout = 0;
+        if (before(&now, wakeup)){
+            timerspecsub(wakeup, &now, &elapsed);
+            timeout = (timespec_to_ns(&elapsed) + 999999L) / 1000000L;
+        }
+    }
+    
+    if (poll(fds, nfds, timeout) > 0){
+        for (int i = 0; i < nfds; i++){
+            if (fds[i].revents & POLLIN){
+                drain(fds[i].fd);
+                owners[i]->woken = 1;
+            }
+        }
+    }
+}
+
+#endif
+
+
+
+// Pacing loop. Runs every machine that is due, woken up by
+// input or not paced, and waits for the next one. Blocked
+// machines run again when woken up or after BLOCKED_WAKEUP.
+// Never returns
+void pacer_run(void){
+    setup_events();
+    
+    while(1){
+        struct timespec now, wakeup;
+        int busy = 0;
+        int waiting = 0;
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < machine_count; i++){
+            machine *m = machines[i];
+            if (m->blocked && (m->woken || !before(&now, &m->next))){
+                // No emulated time has passed while blocked
+                m->blocked = 0;
+                m->woken = 1;
+                clock_gettime(CLOCK_MONOTONIC, &m->next);
+            }
+            if (m->woken || !(m->blocked || (m->paced && before(&now, &m->next)))){
+                m->woken = 0;
+                run_machine(m);
+            }
+            
+            if (!m->paced && !m->blocked){
+                busy = 1;
+            } else if (!waiting || before(&m->next, &wakeup)){
+                wakeup = m->next;
+                waiting = 1;
+            }
+        }
+        
+        wait_events(waiting ? &wakeup : NULL, busy);
+    }
+}
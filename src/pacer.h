@@ -0,0 +1,49 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef pacer_h
+    #define pacer_h
+    #include <stdint.h>
+    #include <time.h>
+
+    // Maximum number of machines paced by one thread
+    #define PACER_MAX_MACHINES 256
+
+    typedef struct machine{
+        // Runs one slice and returns the cycles executed.
+        // It also updates paced for the next slice
+        long (*run_slice)(struct machine *m);
+        
+        // 1 to run at 1.000 MHz, 0 to run as fast as possible
+        uint8_t paced;
+        
+        // Readable when there is input for the machine,
+        // which then runs without waiting for its turn.
+        // -1 if not used
+        int event_fd;
+        
+        // Set by run_slice when the machine can't run
+        // until there is input for it
+        uint8_t blocked;
+        
+        // Used by the pacer
+        struct timespec next; // When the next slice is due
+        uint8_t woken;        // Input arrived
+    } machine;
+
+    void pacer_add(machine *m);
+    void pacer_run(void);
+#endif
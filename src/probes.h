@@ -0,0 +1,51 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef probes_h
+    #define probes_h
+
+    // Static tracepoints for bpftrace, perf or SystemTap, in
+    // the 'uk101re' provider. With <sys/sdt.h> (systemtap-sdt-dev
+    // or systemtap-sdt-devel) each probe is a single nop until a
+    // tracer attaches to it. Without it, or when compiled with
+    // -DNO_PROBES, they expand to nothing. List them with:
+    //
+    //   readelf -n uk101re
+    //
+    // Probes and arguments:
+    //
+    //   slice__start      slice length (cycles)
+    //   slice__end        cycles, instructions executed
+    //   cpu__reset        new PC
+    //   cpu__illegal      opcode, PC
+    //   cpu__irq          vector, PC pushed
+    //   acia__tdr__write  byte
+    //   acia__rdr__read   byte
+    #if !defined(NO_PROBES) && defined(__has_include)
+        #if __has_include(<sys/sdt.h>)
+            #include <sys/sdt.h>
+            #define PROBES_ENABLED
+        #endif
+    #endif
+
+    #ifdef PROBES_ENABLED
+        #define PROBE1(name, a) DTRACE_PROBE1(uk101re, name, a)
+        #define PROBE2(name, a, b) DTRACE_PROBE2(uk101re, name, a, b)
+    #else
+        #define PROBE1(name, a)
+        #define PROBE2(name, a, b)
+    #endif
+#endif
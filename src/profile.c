@@ -0,0 +1,177 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Memory access profiler. Counts reads, writes and instruction
+// fetches of every address, and the pages (256 bytes) touched
+// during every million cycles, that is, every emulated second.
+// On exit it writes a report with the counts of every page, a
+// heatmap of the whole address space and the working set size
+// over time. Reads include instruction fetches
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "options.h"
+#include "profile.h"
+
+#ifdef PROFILE_MEMORY
+
+// Cycles between working set samples
+#define PROFILE_INTERVAL 1000000
+
+// Heatmap characters, from untouched to the most used page
+static const char heat[] = " .:-=+*#%@";
+
+uint32_t profile_reads[0x10000];
+uint32_t profile_writes[0x10000];
+uint32_t profile_fetches[0x10000];
+uint8_t profile_touched[0x100];
+
+static uint64_t next_sample = PROFILE_INTERVAL;
+static uint16_t *working_set = NULL;
+static long samples = 0;
+static long samples_size = 0;
+
+
+
+// Number of bits needed for a value, a cheap logarithm
+static int bits(uint64_t value){
+    int n = 0;
+    while (value){
+        value >>= 1;
+        n++;
+    }
+    return n;
+}
+
+
+
+static void write_report(FILE *f){
+    uint64_t page_accesses[0x100];
+    uint64_t reads, writes, fetches, max = 0;
+    int total_pages = 0;
+    
+    fprintf(f, "Memory profile\n\n");
+    fprintf(f, "Page  Reads       Writes      Fetches\n");
+    for (int page = 0; page < 0x100; page++){
+        reads = writes = fetches = 0;
+        for (int i = page << 8; i < ((page + 1) << 8); i++){
+            reads += profile_reads[i];
+            writes += profile_writes[i];
+            fetches += profile_fetches[i];
+        }
+        page_accesses[page] = reads + writes;
+        if (page_accesses[page] > max){
+            max = page_accesses[page];
+        }
+        if (page_accesses[page]){
+            total_pages++;
+            fprintf(f, "%02X    %-10llu  %-10llu  %llu\n", page,
+                (unsigned long long)reads, (unsigned long long)writes,
+                (unsigned long long)fetches);
+        }
+    }
+    fprintf(f, "\nPages touched: %d (%d bytes)\n", total_pages, total_pages << 8);
+    
+    // One character per page, one row per 4 kB, with a
+    // logarithmic scale relative to the most used page
+    fprintf(f, "\nHeatmap (log scale, '%c' = most used page)\n\n", heat[sizeof(heat) - 2]);
+    fprintf(f, "      0123456789ABCDEF\n");
+    for (int row = 0; row < 0x10; row++){
+        fprintf(f, "%X000  ", row);
+        for (int column = 0; column < 0x10; column++){
+            uint64_t accesses = page_accesses[(row << 4) | column];
+            int level = 0;
+            if (accesses){
+                level = 1 + ((sizeof(heat) - 3) * bits(accesses)) / bits(max);
+            }
+            fputc(heat[level], f);
+        }
+        fputc('\n', f);
+    }
+    
+    fprintf(f, "\nWorking set (pages touched every %d cycles)\n\n", PROFILE_INTERVAL);
+    fprintf(f, "Cycles       Pages\n");
+    for (long i = 0; i < samples; i++){
+        fprintf(f, "%-11llu  %u\n", (unsigned long long)(i + 1) * PROFILE_INTERVAL, working_set[i]);
+    }
+}
+
+
+
+static void profile_hook(void){
+    FILE *f = fopen(options.profile, "w");
+    if (f == NULL){
+        fprintf(stderr, "Error: can't create %s\n", options.profile);
+        return;
+    }
+    write_report(f);
+    fclose(f);
+}
+
+
+
+// Called at the end of every slice with the total cycles
+// executed. A slice longer than the interval, as in turbo
+// mode, gives every interval it spans the pages it touched
+void profile_slice(uint64_t cycles){
+    int pages = 0;
+    
+    if ((options.profile == NULL) || (cycles < next_sample)){
+        return;
+    }
+    for (int page = 0; page < 0x100; page++){
+        pages += profile_touched[page];
+        profile_touched[page] = 0;
+    }
+    while (cycles >= next_sample){
+        next_sample += PROFILE_INTERVAL;
+        if (samples == samples_size){
+            samples_size = samples_size ? samples_size * 2 : 1024;
+            working_set = realloc(working_set, samples_size * sizeof(*working_set));
+            if (working_set == NULL){
+                fprintf(stderr, "Error: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        working_set[samples++] = pages;
+    }
+}
+
+
+
+void configure_profile(void){
+    if (options.profile){
+        atexit(profile_hook);
+    }
+}
+
+#else
+
+void profile_slice(uint64_t cycles){
+}
+
+
+
+void configure_profile(void){
+    if (options.profile){
+        fprintf(stderr, "Error: memory profiling not compiled in, use 'make clean && make CFLAGS=\"-O2 -DPROFILE_MEMORY\"'\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+#endif
@@ -0,0 +1,40 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef profile_h
+    #define profile_h
+    #include <stdint.h>
+
+    // Memory profiling is compiled in with
+    // 'make clean && make CFLAGS="-O2 -DPROFILE_MEMORY"'.
+    // Otherwise the hooks in the bus and the CPU are empty
+    #ifdef PROFILE_MEMORY
+        extern uint32_t profile_reads[0x10000];
+        extern uint32_t profile_writes[0x10000];
+        extern uint32_t profile_fetches[0x10000];
+        extern uint8_t profile_touched[0x100];
+        #define PROFILE_READ(address) (profile_reads[address]++, profile_touched[(address) >> 8] = 1)
+        #define PROFILE_WRITE(address) (profile_writes[address]++, profile_touched[(address) >> 8] = 1)
+        #define PROFILE_FETCH(address) (profile_fetches[address]++)
+    #else
+        #define PROFILE_READ(address)
+        #define PROFILE_WRITE(address)
+        #define PROFILE_FETCH(address)
+    #endif
+
+    void configure_profile(void);
+    void profile_slice(uint64_t cycles);
+#endif
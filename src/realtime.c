@@ -0,0 +1,76 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifdef __linux__
+    #define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "options.h"
+
+
+
+// Runs the emulation thread in the requested CPU
+static void pin_cpu(int cpu){
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err){
+        fprintf(stderr, "Warning: can't pin to CPU %d: %s\n", cpu, strerror(err));
+    }
+#else
+    fprintf(stderr, "Warning: CPU pinning not supported in this system\n");
+#endif
+}
+
+
+
+// Asks for SCHED_FIFO and locks all memory so page faults
+// don't add latency. Failures are not fatal because usually
+// they just mean we don't have enough privileges
+static void set_realtime(void){
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err){
+        fprintf(stderr, "Warning: can't set SCHED_FIFO: %s\n", strerror(err));
+    }
+    
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)){
+        perror("Warning: can't lock memory");
+    }
+}
+
+
+
+// Only the calling thread (the emulation thread) is affected.
+// The stdin thread keeps the default scheduling
+void configure_realtime(void){
+    if (options.cpu >= 0){
+        pin_cpu(options.cpu);
+    }
+    if (options.flag_realtime){
+        set_realtime();
+    }
+}
@@ -0,0 +1,229 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Second serial channel for bulk data, an ACIA like the console
+// one (status and control at even addresses, data at odd ones)
+// decoded at SERIAL_BASE. It is enabled by --serial-in and
+// --serial-out, each a file, FIFO or Unix socket; both can be
+// the same socket.
+//
+// Input is read from the host in large blocks, at most once
+// every REFILL_GAP cycles while the buffer is empty, so polling
+// the status doesn't make a system call each time. Output is
+// buffered too, and written at the end of every slice and when
+// the buffer fills. The transmitter is always ready
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpu6502.h"
+#include "hangdetect.h"
+#include "options.h"
+#include "serial.h"
+
+#define BUFFER_SIZE 65536
+#define REFILL_GAP 256
+
+#define SR_RDRF 0x01
+#define SR_TDRE 0x02
+
+static uint8_t RDR;
+static uint8_t CR;
+
+static int in_fd = -1;
+static int out_fd = -1;
+static uint8_t in_buffer[BUFFER_SIZE];
+static int in_head, in_tail;
+static int in_closed;
+static int in_fifo;          // No data is not the end of a FIFO
+static uint64_t last_refill;
+static uint8_t out_buffer[BUFFER_SIZE];
+static int out_length;
+
+
+
+// Reads more input if the buffer is empty and it's time to.
+// Returns whether there is input
+static int input_ready(void){
+    if (in_head < in_tail){
+        return 1;
+    }
+    uint64_t now = cpu_total_cycles();
+    if ((in_fd < 0) || in_closed || (now - last_refill < REFILL_GAP)){
+        return 0;
+    }
+    last_refill = now;
+    ssize_t got = read(in_fd, in_buffer, BUFFER_SIZE);
+    if (got > 0){
+        in_head = 0;
+        in_tail = got;
+        return 1;
+    }
+    if (got == 0){
+        // End of file, or the other end of a socket closed. A FIFO
+        // also reads nothing until a writer opens it, or after it
+        // closes, and the next writer may come later
+        in_closed = !in_fifo;
+    } else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)){
+        in_closed = 1;
+    }
+    return 0;
+}
+
+
+
+void serial_flush(void){
+    int done = 0;
+    
+    while (done < out_length){
+        ssize_t wrote = write(out_fd, out_buffer + done, out_length - done);
+        if (wrote < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)){
+                // Shared with the non blocking input
+                struct pollfd ready = {out_fd, POLLOUT, 0};
+                poll(&ready, 1, -1);
+                continue;
+            }
+            // Reported once, then output is discarded. This
+            // also runs from an exit hook, so it can't exit
+            perror("Error: can't write serial output");
+            close(out_fd);
+            out_fd = -1;
+            break;
+        }
+        done += wrote;
+    }
+    out_length = 0;
+}
+
+
+
+static void exit_hook(void){
+    serial_flush();
+}
+
+
+
+void serial_reset(void){
+    RDR = 0x00;
+    CR = 0x00;
+}
+
+
+
+uint8_t serial_readbyte(uint16_t address){
+    if (!(address & 0x0001)){
+        // SR
+        if (input_ready()){
+            return SR_TDRE | SR_RDRF;
+        }
+        // Waiting for data is not hung
+        hang_io();
+        return SR_TDRE;
+    }
+    // RDR
+    if (input_ready()){
+        RDR = in_buffer[in_head++];
+        hang_io();
+    }
+    return RDR;
+}
+
+
+
+void serial_writebyte(uint16_t address, uint8_t data){
+    if (!(address & 0x0001)){
+        CR = data;
+        return;
+    }
+    // TDR
+    if (out_fd < 0){
+        return;
+    }
+    out_buffer[out_length++] = data;
+    hang_io();
+    if (out_length == BUFFER_SIZE){
+        serial_flush();
+    }
+}
+
+
+
+// Opens a file, FIFO or socket. Sockets are connected
+static int open_channel(const char *path, int flags){
+    struct sockaddr_un address;
+    struct stat info;
+    int fd;
+    
+    if (!stat(path, &info) && S_ISSOCK(info.st_mode)){
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(address.sun_path)){
+            fprintf(stderr, "Error: socket path too long: %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(address.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((fd >= 0) && connect(fd, (struct sockaddr *)&address, sizeof(address))){
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        fd = open(path, flags, 0644);
+    }
+    if (fd < 0){
+        fprintf(stderr, "Error: can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+
+
+void configure_serial(void){
+    struct stat info;
+    int in_socket = 0;
+    
+    if (options.serial_in){
+        in_fd = open_channel(options.serial_in, O_RDONLY | O_NONBLOCK);
+        fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+        if (!fstat(in_fd, &info)){
+            in_fifo = S_ISFIFO(info.st_mode);
+            in_socket = S_ISSOCK(info.st_mode);
+        }
+    }
+    if (options.serial_out){
+        if (in_socket && !strcmp(options.serial_in, options.serial_out)){
+            // One connection both ways
+            out_fd = dup(in_fd);
+        } else {
+            out_fd = open_channel(options.serial_out, O_WRONLY | O_CREAT | O_TRUNC);
+        }
+        atexit(exit_hook);
+    }
+}
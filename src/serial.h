@@ -0,0 +1,30 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef serial_h
+    #define serial_h
+    #include <stdint.h>
+
+    // Second ACIA, decoded at SERIAL_BASE when enabled
+    #define SERIAL_BASE 0xF100
+    #define SERIAL_END 0xF1FF
+
+    void serial_reset(void);
+    uint8_t serial_readbyte(uint16_t address);
+    void serial_writebyte(uint16_t address, uint8_t data);
+    void serial_flush(void);
+    void configure_serial(void);
+#endif
@@ -0,0 +1,231 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Snapshots of the whole computer
+//
+// Format (host byte order, so they are meant to be resumed
+// in the same kind of host):
+//
+//   "UK101RE" + NUL     Magic
+//   uint32_t            Version
+//   uint64_t            ROM hash
+//   cpu_state           CPU registers
+//   mc6850_state        ACIA registers
+//   int64_t             Datafile position, -1 if none
+//   uint16_t + chars    Datafile name
+//   uint64_t x 3        Cycles, instructions and output bytes
+//   video_state         Video RAM
+//   dma_state           DMA controller
+//   fpu_state           Floating point coprocessor
+//   keyboard_state      Keyboard matrix
+//   RAMSIZE bytes       RAM
+//
+// The optional devices are saved even when not enabled
+//
+// Everything but the RAM is the devices state, which is also
+// used to migrate a running computer (see migrate.c)
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu6502.h"
+#include "dma.h"
+#include "fpu.h"
+#include "keyboard.h"
+#include "mc6850.h"
+#include "motherboard.h"
+#include "options.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "terminal.h"
+#include "video.h"
+
+#define SNAPSHOT_MAGIC "UK101RE"
+#define SNAPSHOT_VERSION 2
+
+
+
+// Write errors are checked by the caller with ferror()
+static void write_block(FILE *f, const void *data, size_t size){
+    fwrite(data, 1, size, f);
+}
+
+
+
+static void read_block(FILE *f, void *data, size_t size, const char *filename){
+    if (fread(data, 1, size, f) != size){
+        fprintf(stderr, "Error: bad snapshot %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+// Writes the state of every device but the RAM
+void snapshot_write_devices(FILE *f){
+    cpu_state cpu;
+    mc6850_state acia;
+    static video_state video;
+    dma_state dma;
+    fpu_state fpu;
+    keyboard_state keyboard;
+    uint32_t version = SNAPSHOT_VERSION;
+    uint64_t rom_hash = motherboard_rom_hash();
+    int64_t position = terminal_datafile_position();
+    uint16_t length = 0;
+    
+    cpu_get_state(&cpu);
+    mc6850_get_state(&acia);
+    video_get_state(&video);
+    dma_get_state(&dma);
+    fpu_get_state(&fpu);
+    keyboard_get_state(&keyboard);
+    if (position >= 0){
+        length = strlen(options.datafile);
+    }
+    
+    write_block(f, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    write_block(f, &version, sizeof(version));
+    write_block(f, &rom_hash, sizeof(rom_hash));
+    write_block(f, &cpu, sizeof(cpu));
+    write_block(f, &acia, sizeof(acia));
+    write_block(f, &position, sizeof(position));
+    write_block(f, &length, sizeof(length));
+    write_block(f, options.datafile, length);
+    write_block(f, &stats.cycles, sizeof(stats.cycles));
+    write_block(f, &stats.instructions, sizeof(stats.instructions));
+    write_block(f, &stats.output_bytes, sizeof(stats.output_bytes));
+    write_block(f, &video, sizeof(video));
+    write_block(f, &dma, sizeof(dma));
+    write_block(f, &fpu, sizeof(fpu));
+    write_block(f, &keyboard, sizeof(keyboard));
+}
+
+
+
+void snapshot_read_devices(FILE *f, const char *filename){
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    cpu_state cpu;
+    mc6850_state acia;
+    static video_state video;
+    dma_state dma;
+    fpu_state fpu;
+    keyboard_state keyboard;
+    uint32_t version;
+    uint64_t rom_hash;
+    int64_t position;
+    uint16_t length;
+    
+    read_block(f, magic, sizeof(magic), filename);
+    read_block(f, &version, sizeof(version), filename);
+    if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) || (version != SNAPSHOT_VERSION)){
+        fprintf(stderr, "Error: %s is not a UK101RE snapshot\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    
+    read_block(f, &rom_hash, sizeof(rom_hash), filename);
+    if (rom_hash != motherboard_rom_hash()){
+        fprintf(stderr, "Error: snapshot %s was taken with another ROM\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    
+    read_block(f, &cpu, sizeof(cpu), filename);
+    read_block(f, &acia, sizeof(acia), filename);
+    read_block(f, &position, sizeof(position), filename);
+    read_block(f, &length, sizeof(length), filename);
+    char *datafile = malloc(length + 1);
+    read_block(f, datafile, length, filename);
+    datafile[length] = 0;
+    read_block(f, &stats.cycles, sizeof(stats.cycles), filename);
+    read_block(f, &stats.instructions, sizeof(stats.instructions), filename);
+    read_block(f, &stats.output_bytes, sizeof(stats.output_bytes), filename);
+    read_block(f, &video, sizeof(video), filename);
+    read_block(f, &dma, sizeof(dma), filename);
+    read_block(f, &fpu, sizeof(fpu), filename);
+    read_block(f, &keyboard, sizeof(keyboard), filename);
+    
+    cpu_set_state(&cpu);
+    mc6850_set_state(&acia);
+    video_set_state(&video);
+    dma_set_state(&dma);
+    fpu_set_state(&fpu);
+    keyboard_set_state(&keyboard);
+    if (position >= 0){
+        terminal_datafile_seek(datafile, position);
+    } else {
+        free(datafile);
+    }
+}
+
+
+
+// Snapshots are written to a temporary file and renamed
+// so an interrupted write never destroys the previous one
+void snapshot_save(char *filename){
+    char *tempname = malloc(strlen(filename) + 5);
+    sprintf(tempname, "%s.tmp", filename);
+    
+    FILE *f = fopen(tempname, "wb");
+    if (f==NULL){
+        fprintf(stderr, "Error: can't create %s\n", tempname);
+        exit(EXIT_FAILURE);
+    }
+    snapshot_write_devices(f);
+    write_block(f, motherboard_ram(), RAMSIZE);
+    if (ferror(f) | fclose(f) || rename(tempname, filename)){
+        fprintf(stderr, "Error: can't write %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    free(tempname);
+    stats.snapshots_saved++;
+}
+
+
+
+void snapshot_load(char *filename){
+    FILE *f = fopen(filename, "rb");
+    if (f==NULL){
+        fprintf(stderr, "Error: can't open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    static uint8_t ram[RAMSIZE];
+    snapshot_read_devices(f, filename);
+    read_block(f, ram, RAMSIZE, filename);
+    motherboard_write_ram(0x0000, ram, RAMSIZE);
+    fclose(f);
+    stats.snapshots_loaded++;
+}
+
+
+
+// SIGTERM and SIGINT ask for a checkpoint. It is written
+// by the main loop once the current slice is finished
+static void checkpoint_signal_handler(int signum){
+    ACTION[ACTION_CHECKPOINT] = 1;
+    terminal_notify();
+}
+
+
+
+void configure_snapshot(void){
+    if (options.checkpoint){
+        signal(SIGTERM, checkpoint_signal_handler);
+        signal(SIGINT, checkpoint_signal_handler);
+    }
+}
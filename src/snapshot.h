@@ -0,0 +1,29 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef snapshot_h
+    #define snapshot_h
+    #include <stdio.h>
+
+    // Exit code after writing a checkpoint
+    #define EXIT_CHECKPOINT 9
+
+    void configure_snapshot(void);
+    void snapshot_save(char *filename);
+    void snapshot_load(char *filename);
+    void snapshot_write_devices(FILE *f);
+    void snapshot_read_devices(FILE *f, const char *filename);
+#endif
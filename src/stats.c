@@ -0,0 +1,74 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "options.h"
+#include "stats.h"
+
+uk101re_stats stats;
+volatile sig_atomic_t stats_requested = 0;
+
+
+
+void show_stats(FILE *f){
+    uint64_t avg_slice = stats.slices ? stats.cycles / stats.slices : 0;
+    uint64_t avg_latency = stats.input_bytes ? stats.input_latency_total / stats.input_bytes : 0;
+
+    fprintf(f, "\n");
+    fprintf(f, "Cycles executed:     %" PRIu64 "\n", stats.cycles);
+    fprintf(f, "Instructions:        %" PRIu64 "\n", stats.instructions);
+    fprintf(f, "Slices executed:     %" PRIu64 " (%" PRIu64 " at minimum length)\n", stats.slices, stats.short_slices);
+    fprintf(f, "Average slice:       %" PRIu64 " cycles\n", avg_slice);
+    fprintf(f, "Sleeps:              %" PRIu64 "\n", stats.sleeps);
+    fprintf(f, "Overruns:            %" PRIu64 "\n", stats.overruns);
+    fprintf(f, "Input bytes:         %" PRIu64 "\n", stats.input_bytes);
+    fprintf(f, "Input latency (avg): %" PRIu64 " us\n", avg_latency / 1000);
+    fprintf(f, "Input latency (max): %" PRIu64 " us\n", stats.input_latency_max / 1000);
+    fprintf(f, "Output bytes:        %" PRIu64 " (%" PRIu64 " not displayed)\n", stats.output_bytes, stats.output_dropped);
+    histogram_print(f, "Pacing lateness:", &stats.lateness);
+    histogram_print(f, "Key to ROM read:", &stats.key_read);
+    histogram_print(f, "ROM read to echo:", &stats.key_echo);
+    histogram_print(f, "Echo to terminal:", &stats.key_output);
+}
+
+
+
+// Executed whenever the program exits
+// and statistics have been requested
+static void stats_hook(void){
+    show_stats(stderr);
+}
+
+
+
+// SIGUSR1 asks for the statistics. They are
+// printed by the main loop between slices
+static void stats_signal_handler(int signum){
+    stats_requested = 1;
+}
+
+
+
+void configure_stats(void){
+    if (options.flag_stats){
+        atexit(stats_hook);
+    }
+    signal(SIGUSR1, stats_signal_handler);
+}
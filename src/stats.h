@@ -0,0 +1,66 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef stats_h
+    #define stats_h
+    #include <signal.h>
+    #include <stdint.h>
+    #include <stdio.h>
+    #include "histogram.h"
+
+    typedef struct{
+        // Scheduler
+        uint64_t slices;            // Slices executed
+        uint64_t cycles;            // Emulated cycles executed
+        uint64_t instructions;      // Instructions executed
+        uint64_t sleeps;            // Slices followed by a sleep
+        uint64_t overruns;          // Slices that took longer than real time
+        uint64_t short_slices;      // Slices run at minimum length
+
+        // Input latency: from the byte arriving at stdin
+        // to the ROM reading it from the ACIA
+        uint64_t input_bytes;
+        uint64_t input_latency_total; // ns
+        uint64_t input_latency_max;   // ns
+        uint64_t datafile_bytes;      // Read from datafiles
+
+        // Output
+        uint64_t output_bytes;
+        uint64_t output_dropped;      // Not shown when throttling
+
+        // Snapshots
+        uint64_t snapshots_saved;
+        uint64_t snapshots_loaded;
+
+        // How late each paced slice started, in ns
+        histogram lateness;
+
+        // Keystroke to echo stages, in ns: from stdin to the
+        // ROM reading it, from that to the ROM writing the next
+        // byte (the echo) and from that to the byte being
+        // written to stdout. Keys can also wait up to the 20 ms
+        // stdin polling interval before this, unmeasured
+        histogram key_read;
+        histogram key_echo;
+        histogram key_output;
+    } uk101re_stats;
+
+    extern uk101re_stats stats;
+    extern volatile sig_atomic_t stats_requested;
+
+    void configure_stats(void);
+    void show_stats(FILE *f);
+#endif
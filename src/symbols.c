@@ -0,0 +1,158 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Symbol table for the ROM. Symbol files have one label per
+// line, an hexadecimal address and a name, optionally followed
+// by 'code' when the address is a routine entry point:
+//
+//   ; CEGMON
+//   F800 RESET code
+//   FB46 KEYTABLE
+//
+// Everything after a ';' or '#' is a comment
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+
+
+static symbol *symbols = NULL;
+static int count = 0;
+
+
+
+static int compare_symbols(const void *a, const void *b){
+    return (int)((const symbol *)a)->address - (int)((const symbol *)b)->address;
+}
+
+
+
+void symbols_load(char *filename){
+    char line[256], name[SYMBOL_LENGTH], kind[8];
+    unsigned int address;
+    int size = 0, number = 0;
+    
+    FILE *f = fopen(filename, "r");
+    if (f == NULL){
+        fprintf(stderr, "Error: can't open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), f)){
+        number++;
+        line[strcspn(line, ";#\n")] = 0;
+        kind[0] = 0;
+        int fields = sscanf(line, "%x %31s %7s", &address, name, kind);
+        if (fields <= 0){
+            // Blank line or comment
+            continue;
+        }
+        if ((fields < 2) || (address > 0xFFFF) || ((fields == 3) && strcmp(kind, "code"))){
+            fprintf(stderr, "Error: bad symbol in %s, line %d\n", filename, number);
+            exit(EXIT_FAILURE);
+        }
+        if (count == size){
+            size = size ? size * 2 : 256;
+            symbols = realloc(symbols, size * sizeof(symbol));
+            if (symbols == NULL){
+                fprintf(stderr, "Error: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        symbols[count].address = address;
+        symbols[count].code = (fields == 3);
+        strcpy(symbols[count].name, name);
+        count++;
+    }
+    fclose(f);
+    qsort(symbols, count, sizeof(symbol), compare_symbols);
+}
+
+
+
+// Index of the last symbol at or below an address, or -1
+static int find(uint16_t address){
+    int low = 0, high = count - 1, found = -1;
+    while (low <= high){
+        int middle = (low + high) / 2;
+        if (symbols[middle].address <= address){
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return found;
+}
+
+
+
+// Name of the symbol at an address, NULL if there is none
+const char *symbols_name(uint16_t address){
+    int i = find(address);
+    if ((i >= 0) && (symbols[i].address == address)){
+        return symbols[i].name;
+    }
+    return NULL;
+}
+
+
+
+// Writes an address as 'NAME', 'NAME+$12' for addresses up to
+// 256 bytes past a symbol, or '$ABCD' otherwise
+void symbols_describe(uint16_t address, char *buffer, size_t size){
+    int i = find(address);
+    if ((i >= 0) && (address - symbols[i].address < 0x100)){
+        if (symbols[i].address == address){
+            snprintf(buffer, size, "%s", symbols[i].name);
+        } else {
+            snprintf(buffer, size, "%s+$%02X", symbols[i].name, address - symbols[i].address);
+        }
+    } else {
+        snprintf(buffer, size, "$%04X", address);
+    }
+}
+
+
+
+int symbols_count(void){
+    return count;
+}
+
+
+
+const symbol *symbols_get(int index){
+    return &symbols[index];
+}
+
+
+
+// FNV-1a hash of the code entry points, which
+// change the disassembly database
+uint64_t symbols_hash(void){
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < count; i++){
+        if (symbols[i].code){
+            hash ^= symbols[i].address & 0xFF;
+            hash *= 0x100000001B3ULL;
+            hash ^= symbols[i].address >> 8;
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,36 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef symbols_h
+    #define symbols_h
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #define SYMBOL_LENGTH 32
+
+    typedef struct{
+        uint16_t address;
+        uint8_t code;               // Entry point for the disassembler
+        char name[SYMBOL_LENGTH];
+    } symbol;
+
+    void symbols_load(char *filename);
+    const char *symbols_name(uint16_t address);
+    void symbols_describe(uint16_t address, char *buffer, size_t size);
+    int symbols_count(void);
+    const symbol *symbols_get(int index);
+    uint64_t symbols_hash(void);
+#endif
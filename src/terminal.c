@@ -15,17 +15,24 @@
 //
 
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "coroutine.h"
+#include "dump.h"
 #include "options.h"
+#include "stats.h"
 #include "terminal.h"
 #include "timeutils.h"
 
@@ -41,10 +48,28 @@ static int oldf;
 static uint8_t last_key;
 static volatile int stdin_value;
 static volatile uint8_t stdin_has_data = 0;
+static struct timespec stdin_timestamp;
+static uint8_t echo_pending = 0;
+static struct timespec echo_timestamp;
+static uint8_t output_pending = 0;
+static struct timespec output_timestamp;
+static int output_index;
+static volatile uint8_t io_activity = 0;
+static int event_pipe[2];
+static uint8_t input_wait = 0;
+static struct timespec idle_timestamp;
+static uint8_t idle = 0;
 static FILE *datafile;
 static long datasize;
+static FILE *logfile;
+static int throttle_fd = -1;
 
-int ACTION = 0;
+// Output buffer used when throttling output
+#define OUTPUT_BUFFER 65536
+static uint8_t output_buffer[OUTPUT_BUFFER];
+static int output_length = 0;
+
+volatile sig_atomic_t ACTION[ACTIONS];
 
 
 
@@ -56,15 +81,113 @@ static void restore_terminal(void){
 
 
 
+// Records in a histogram the time elapsed since a timestamp
+static void record_since(histogram *h, struct timespec *timestamp){
+    struct timespec now, elapsed;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timerspecsub(&now, timestamp, &elapsed);
+    histogram_record(h, timespec_to_ns(&elapsed));
+}
+
+
+
+// Writes the output buffer to the terminal. If wait is zero
+// it only writes what the terminal accepts without blocking
+static void flush_output(int wait){
+    int written = 0;
+    
+    fflush(stdout);
+    while (written < output_length){
+        ssize_t n = write(throttle_fd, output_buffer + written, output_length - written);
+        if (n > 0){
+            written += n;
+        } else if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR))){
+            if (!wait){
+                break;
+            }
+            struct pollfd pfd = {.fd = throttle_fd, .events = POLLOUT};
+            poll(&pfd, 1, -1);
+        } else {
+            // Can't write at all: discard
+            written = output_length;
+        }
+    }
+    
+    output_length -= written;
+    memmove(output_buffer, output_buffer + written, output_length);
+    if (output_pending){
+        output_index -= written;
+        if (output_index < 0){
+            record_since(&stats.key_output, &output_timestamp);
+            output_pending = 0;
+        }
+    }
+}
+
+
+
+// Discards the oldest half of the output buffer, up to the
+// next line start, so the display resumes with a whole line
+static void drop_output(void){
+    int drop = OUTPUT_BUFFER / 2;
+    while ((drop < output_length) && (output_buffer[drop - 1] != 0x0A)){
+        drop++;
+    }
+    stats.output_dropped += drop;
+    output_length -= drop;
+    memmove(output_buffer, output_buffer + drop, output_length);
+    if (output_pending){
+        output_index -= drop;
+        if (output_index < 0){
+            // The echo was never shown
+            output_pending = 0;
+        }
+    }
+}
+
+
+
 // Executed whenever the program exists AND terminal
 // has been configured into RAW mode
 static void exit_hook(void){
-    printf("\n*** Ctrl-X ***\n");
+    flush_output(1);
     restore_terminal();    
 }
 
 
 
+// Returns whether any user action is waiting
+int terminal_action_pending(void){
+    for (int action = 1; action < ACTIONS; action++){
+        if (ACTION[action]){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+// Clears an action, returns whether it was pending
+int terminal_take_action(int action){
+    if (!ACTION[action]){
+        return 0;
+    }
+    ACTION[action] = 0;
+    return 1;
+}
+
+
+
+// Wakes up the pacer. Safe to call from signal handlers
+void terminal_notify(void){
+    if (write(event_pipe[1], "", 1) < 0){
+        // Pipe full: the pacer is already woken
+    }
+}
+
+
+
 // Polling the keyboard (stdin) as frequently as
 // the 6502 CPU does in the UK101 produces an excesive
 // CPU usage. Here we are limiting the polling interval
@@ -76,17 +199,26 @@ static void *stdin_handler(void *args){
         if (ch != EOF){
             switch(ch){
                 case CTRL_R:
-                    ACTION = ACTION_RESET;
+                    ACTION[ACTION_RESET] = 1;
+                    terminal_notify();
+                    break;
+                case CTRL_W:
+                    ACTION[ACTION_DUMP] = 1;
+                    terminal_notify();
                     break;
                 case CTRL_X:
+                    printf("\n*** Ctrl-X ***\n");
                     exit(EXIT_SUCCESS);
                     break;
                 default:
                     while(stdin_has_data){
                         nanosleep(&stdin_polling_interval, NULL);
                     };
+                    clock_gettime(CLOCK_MONOTONIC, &stdin_timestamp);
                     stdin_value = ch;
                     stdin_has_data = 1;
+                    io_activity = 1;
+                    terminal_notify();
                     break;
             }
         }
@@ -118,6 +250,28 @@ void configure_terminal(void){
     oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
     fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);    
     
+    // When throttling, output to the terminal never blocks. The
+    // terminal or pipe is opened again so the non blocking flag
+    // doesn't reach the other writers of stdout. Files never block
+    if (options.flag_throttle){
+        struct stat info;
+        if (!fstat(STDOUT_FILENO, &info) && (S_ISCHR(info.st_mode) || S_ISFIFO(info.st_mode))){
+            throttle_fd = open("/proc/self/fd/1", O_WRONLY | O_NONBLOCK);
+        }
+        if (throttle_fd < 0){
+            throttle_fd = dup(STDOUT_FILENO);
+        }
+    }
+    
+    // Open the output log
+    if (options.logfile){
+        logfile = fopen(options.logfile, "wb");
+        if (logfile==NULL){
+            fprintf(stderr, "Error: can't create %s\n", options.logfile);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
     // Setup exit hook
     atexit(exit_hook);
     
@@ -125,12 +279,65 @@ void configure_terminal(void){
     clock_gettime(CLOCK_MONOTONIC, &last_char_timestamp);
     last_key_timestamp = last_char_timestamp;
     
+    // Create the pipe used to notify typed keys
+    if (pipe(event_pipe)){
+        perror("Error: can't create pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(event_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(event_pipe[1], F_SETFL, O_NONBLOCK);
+    
     // and start the stdin processing thread
     pthread_t thread_id;
     pthread_create(&thread_id, NULL, &stdin_handler, NULL);
 }
 
 
+// Position of the next byte to read from the
+// datafile, or -1 if not reading a datafile
+long terminal_datafile_position(void){
+    if (options.flag_datafile){
+        return ftell(datafile);
+    }
+    return -1;
+}
+
+
+
+// Bytes waiting to be read by the computer: a typed
+// key and what is left of the datafile
+long terminal_input_queued(void){
+    long queued = stdin_has_data;
+    if (options.flag_datafile){
+        queued += datasize;
+    }
+    return queued;
+}
+
+
+
+// Continues reading a datafile from the given position
+void terminal_datafile_seek(char *filename, long position){
+    if (options.flag_datafile){
+        fclose(datafile);
+    }
+    datafile = fopen(filename, "rb");
+    if (datafile==NULL){
+        fprintf(stderr, "Error: can't open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fseek(datafile, 0L, SEEK_END);
+    datasize = ftell(datafile) - position;
+    fseek(datafile, position, SEEK_SET);
+    options.datafile = filename;
+    options.flag_datafile = datasize > 0;
+    if (!options.flag_datafile){
+        fclose(datafile);
+    }
+}
+
+
+
 // Checks if a key has been typed
 uint8_t check_keyboard_ready(void){
     if (options.flag_datafile){
@@ -148,6 +355,8 @@ uint8_t read_keyboard(void){
         if (datasize){
             ch = fgetc(datafile);
             datasize--;
+            stats.datafile_bytes++;
+            idle = 0;
             if (datasize == 0L){
                 // That was the last character
                 // in file. Deactivate datafile mode
@@ -157,8 +366,22 @@ uint8_t read_keyboard(void){
         }
     } else {
         if (stdin_has_data){
+            struct timespec now, elapsed;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timerspecsub(&now, &stdin_timestamp, &elapsed);
+            uint64_t latency = timespec_to_ns(&elapsed);
+            stats.input_bytes++;
+            stats.input_latency_total += latency;
+            if (latency > stats.input_latency_max){
+                stats.input_latency_max = latency;
+            }
+            histogram_record(&stats.key_read, latency);
+            echo_pending = 1;
+            echo_timestamp = now;
             ch = stdin_value;
             stdin_has_data = 0;
+            io_activity = 1;
+            idle = 0;
         }
     }
     
@@ -171,8 +394,143 @@ uint8_t read_keyboard(void){
 }
 
 
+// Reads a whole line from the datafile, without its CR or LF.
+// Characters past the buffer size are dropped. Returns the
+// length, or -1 if not reading a datafile
+int terminal_read_line(uint8_t *buffer, int size){
+    int length = 0;
+    if (!options.flag_datafile){
+        return -1;
+    }
+    while (datasize){
+        int ch = fgetc(datafile);
+        datasize--;
+        stats.datafile_bytes++;
+        if ((ch == 0x0A) || (ch == 0x0D)){
+            break;
+        }
+        if (length < size){
+            buffer[length++] = ch;
+        }
+    }
+    idle = 0;
+    if (datasize == 0L){
+        fclose(datafile);
+        options.flag_datafile = 0;
+    }
+    return length;
+}
+
+
+
 // Write to the terminal
 void write_terminal(uint8_t byte){
-    putchar(byte);
-    fflush(stdout);
+    stats.output_bytes++;
+    io_activity = 1;
+    
+    // The first byte written after reading a key is its echo
+    uint8_t echo = echo_pending;
+    if (echo){
+        record_since(&stats.key_echo, &echo_timestamp);
+        clock_gettime(CLOCK_MONOTONIC, &output_timestamp);
+        echo_pending = 0;
+    }
+    
+    if (logfile){
+        fputc(byte, logfile);
+    }
+    
+    dump_output(byte);
+    
+    if (options.flag_throttle){
+        // Buffered until the end of the slice
+        if (output_length == OUTPUT_BUFFER){
+            if (options.flag_turbo | options.flag_datafile){
+                drop_output();
+            } else {
+                flush_output(1);
+            }
+        }
+        if (echo){
+            output_pending = 1;
+            output_index = output_length;
+        }
+        output_buffer[output_length++] = byte;
+    } else {
+        putchar(byte);
+        fflush(stdout);
+        if (echo){
+            record_since(&stats.key_output, &output_timestamp);
+        }
+    }
+}
+
+
+
+// Called between slices. In turbo mode the terminal gets only
+// what it can take right now and the rest waits in the buffer,
+// so a slow terminal never slows down the emulation
+void terminal_flush(void){
+    if (output_length){
+        flush_output(!(options.flag_turbo | options.flag_datafile));
+    }
+}
+
+
+
+// File descriptor that becomes readable
+// whenever a new key is typed
+int terminal_event_fd(void){
+    return event_pipe[0];
+}
+
+
+
+// Called by the ACIA when the computer has nothing to do but
+// waiting for a key. It starts counting the idle time and,
+// if the computer runs inside a coroutine, it yields
+// until a key is typed or there is a user action to process.
+// Otherwise it returns right away and the ROM keeps polling
+void terminal_wait_input(void){
+    if (!idle){
+        clock_gettime(CLOCK_MONOTONIC, &idle_timestamp);
+        idle = 1;
+    }
+    while (coroutine_current() && !check_keyboard_ready() && !terminal_action_pending()){
+        input_wait = 1;
+        coroutine_yield();
+    }
+    input_wait = 0;
+}
+
+
+
+// Returns whether the computer is blocked in terminal_wait_input()
+uint8_t terminal_waiting_input(void){
+    return input_wait;
+}
+
+
+
+// Time in ns the computer has been waiting for input
+// since the last byte was read, 0 if it is not waiting
+long terminal_idle_time(void){
+    struct timespec now, elapsed;
+    if (!idle){
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timerspecsub(&now, &idle_timestamp, &elapsed);
+    return timespec_to_ns(&elapsed);
+}
+
+
+
+// Returns whether keys have been typed or there has been
+// terminal output since the last call, and clears the flag.
+// Reading the datafile doesn't count
+uint8_t terminal_io_activity(void){
+    uint8_t activity = io_activity;
+    io_activity = 0;
+    return activity;
 }
@@ -16,6 +16,7 @@
 
 #ifndef terminal_h
     #define terminal_h
+    #include <signal.h>
     #include <stdint.h>
     
     #define CTRL_A 0x01
@@ -45,12 +46,31 @@
     #define CTRL_Y 0x19
     #define CTRL_Z 0x1A
     
-    #define ACTION_NONE 0
+    // User actions, each with its own flag so a signal
+    // handler never overwrites another pending action
     #define ACTION_RESET 1
+    #define ACTION_CHECKPOINT 2
+    #define ACTION_MIGRATE 3
+    #define ACTION_LOAD 4
+    #define ACTION_DUMP 5
+    #define ACTIONS 6
     
-    extern int ACTION;
+    extern volatile sig_atomic_t ACTION[ACTIONS];
     void configure_terminal(void);
+    int terminal_action_pending(void);
+    int terminal_take_action(int action);
     uint8_t check_keyboard_ready(void);
     uint8_t read_keyboard(void);
     void write_terminal(uint8_t byte);
+    void terminal_flush(void);
+    uint8_t terminal_io_activity(void);
+    int terminal_event_fd(void);
+    void terminal_notify(void);
+    long terminal_datafile_position(void);
+    long terminal_input_queued(void);
+    int terminal_read_line(uint8_t *buffer, int size);
+    void terminal_datafile_seek(char *filename, long position);
+    void terminal_wait_input(void);
+    uint8_t terminal_waiting_input(void);
+    long terminal_idle_time(void);
 #endif 
@@ -34,6 +34,18 @@ void timerspecsub(struct timespec *stop, struct timespec *start, struct timespec
 
 
 
+// Adds an amount of nanoseconds to a timespec
+void timespec_add_ns(struct timespec *t, long ns){
+    t->tv_sec += ns / 1000000000L;
+    t->tv_nsec += ns % 1000000000L;
+    if (t->tv_nsec >= 1000000000L){
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+
+
 // Stops execution for a given amount of time specified in nanoseconds
 int nsleep(long ns){
     struct timespec ts;
@@ -18,6 +18,7 @@
     #define timeutils_h
     #include <time.h>
     void timerspecsub(struct timespec *stop, struct timespec *start, struct timespec *result);
+    void timespec_add_ns(struct timespec *t, long ns);
     int nsleep(long ns);
     long timespec_to_ns(struct timespec *t);
     long timespec_to_us(struct timespec *t);
@@ -0,0 +1,93 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Traps on ROM routines. Host code does the work of the routine
+// and returns to the caller as its RTS would, with the registers
+// and flags left as they were, and charges a fixed number of
+// cycles for it.
+//
+// The output trap goes on the character output routine (or the
+// address its vector points to). The character in A goes straight
+// to the terminal, skipping the ACIA status polling loop.
+//
+// The input trap goes on the line input routine of BASIC (INLIN
+// in Microsoft BASIC). While a datafile is being read, a whole
+// line is copied into the input buffer, ended by a zero, and
+// echoed followed by CR LF. It returns as INLIN does, with X and Y
+// pointing to the byte before the buffer and A zero. Without a
+// datafile the ROM routine runs as usual
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu6502.h"
+#include "hangdetect.h"
+#include "mc6850.h"
+#include "motherboard.h"
+#include "options.h"
+#include "terminal.h"
+#include "traps.h"
+
+// Size of the BASIC input buffer, ending zero included
+#define TRAP_LINE_MAX 72
+
+
+
+static int output_trap(cpu_state *state){
+    write_terminal(state->A);
+    hang_io();
+    cpu_trap_return(state);
+    return options.trap_output_cycles;
+}
+
+
+
+static int input_trap(cpu_state *state){
+    uint8_t line[TRAP_LINE_MAX];
+    int length = terminal_read_line(line, sizeof(line) - 1);
+    uint16_t buffer = options.trap_input_buffer;
+    
+    if (length < 0){
+        return -1;
+    }
+    line[length] = 0;
+    for (int i = 0; i < length; i++){
+        write_terminal(line[i]);
+    }
+    write_terminal(0x0D);
+    write_terminal(0x0A);
+    motherboard_write_ram(buffer, line, length + 1);
+    mc6850_input_taken();
+    hang_io();
+    
+    state->A = 0;
+    state->X = (buffer - 1) & 0xFF;
+    state->Y = (buffer - 1) >> 8;
+    state->P = (state->P & ~0x80) | 0x02; // N clear, Z set
+    cpu_trap_return(state);
+    return options.trap_input_cycles;
+}
+
+
+
+void configure_traps(void){
+    if (options.trap_input >= 0){
+        cpu_set_trap(options.trap_input, input_trap);
+    }
+    if (options.trap_output >= 0){
+        cpu_set_trap(options.trap_output, output_trap);
+    }
+}
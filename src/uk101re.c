@@ -15,13 +15,158 @@
 //
 
 #include <stdio.h>
-#include <time.h>
+#include <stdlib.h>
 
+#include "coroutine.h"
 #include "cpu6502.h"
+#include "disasm.h"
+#include "dump.h"
+#include "fpu.h"
+#include "hypercall.h"
+#include "joblimits.h"
+#include "loader.h"
+#include "metrics.h"
+#include "migrate.h"
 #include "motherboard.h"
 #include "options.h"
+#include "pacer.h"
+#include "probes.h"
+#include "profile.h"
+#include "realtime.h"
+#include "serial.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "symbols.h"
 #include "terminal.h"
-#include "timeutils.h"
+#include "traps.h"
+#include "video.h"
+
+// Slice lengths, in cycles. At 1.000 MHz one cycle is one
+// microsecond. Longer slices mean less pacing overhead but
+// coarser timing of the emulated computer output
+#define SLICE_MIN 1000
+#define SLICE_DEFAULT 20000
+#define SLICE_MAX_PACED 100000
+#define SLICE_MAX_TURBO 1000000
+
+
+static machine uk101;
+static coroutine *uk101_coroutine = NULL;
+static long slice = SLICE_DEFAULT;
+static long slice_cycles;
+static long slice_instructions;
+
+
+
+// Execution loop of the computer when it runs as a coroutine.
+// Device code may yield from inside cpu_execute() to wait for
+// input, so slices can end before running all their cycles
+static void coroutine_loop(void *arg){
+    while(1){
+        while (slice_cycles < slice){
+            slice_cycles += cpu_execute();
+            slice_instructions++;
+        }
+        coroutine_yield();
+    }
+}
+
+
+
+// Runs a slice of the emulated computer. Slices shrink while
+// the user is typing or the computer is printing and grow back
+// while it is just computing. Typed keys wake up the pacer so
+// the shorter slice starts right away
+static long run_slice(machine *m){
+    // Run for a slice
+    slice = limits_slice(slice);
+    slice = dump_slice(slice);
+    slice_cycles = 0;
+    slice_instructions = 0;
+    PROBE1(slice__start, slice);
+    if (uk101_coroutine){
+        coroutine_resume(uk101_coroutine);
+        m->blocked = terminal_waiting_input();
+    } else {
+        while (slice_cycles < slice){
+            slice_cycles += cpu_execute();
+            slice_instructions++;
+        }
+    }
+    long cycles = slice_cycles;
+    PROBE2(slice__end, cycles, slice_instructions);
+    
+    if (terminal_action_pending()){
+        if (terminal_take_action(ACTION_RESET)){
+            printf("\n*** CPU Reset ***\n");
+            cpu_reset();
+        }
+        if (ACTION[ACTION_CHECKPOINT] && terminal_waiting_input()){
+            // The CPU is in the middle of an instruction reading
+            // the ACIA: wake it up and save it once it finishes
+            terminal_notify();
+        } else if (terminal_take_action(ACTION_CHECKPOINT)){
+            snapshot_save(options.checkpoint);
+            fprintf(stderr, "\n*** Checkpoint written to %s ***\n", options.checkpoint);
+            exit(EXIT_CHECKPOINT);
+        }
+        if (terminal_take_action(ACTION_MIGRATE)){
+            migrate_start();
+        }
+        if (terminal_take_action(ACTION_DUMP)){
+            dump_write();
+            fprintf(stderr, "\n*** Memory dumped ***\n");
+        }
+        if (terminal_take_action(ACTION_LOAD)){
+            if (loader_load()){
+                fprintf(stderr, "\n*** Program loaded ***\n");
+            } else {
+                fprintf(stderr, "\n*** Program not loaded, RAM unchanged ***\n");
+            }
+        }
+        // Process other user actions here
+    }
+    
+    terminal_flush();
+    serial_flush();
+    video_render();
+    
+    if (stats_requested){
+        stats_requested = 0;
+        show_stats(stderr);
+    }
+
+    stats.slices++;
+    stats.cycles += cycles;
+    stats.instructions += slice_instructions;
+    if (slice == SLICE_MIN){
+        stats.short_slices++;
+    }
+    profile_slice(stats.cycles);
+    metrics_slice();
+    
+    limits_check();
+    
+    dump_check();
+    
+    migrate_step();
+    
+    m->paced = !(options.flag_turbo | options.flag_datafile);
+    
+    // Compute next slice length. Feeding the datafile is
+    // batch work, so its echoes don't shrink the slice
+    if (terminal_io_activity() && !options.flag_datafile){
+        slice = SLICE_MIN;
+    } else {
+        long slice_max = m->paced ? SLICE_MAX_PACED : SLICE_MAX_TURBO;
+        slice *= 2;
+        if (slice > slice_max){
+            slice = slice_max;
+        }
+    }
+    
+    return cycles;
+}
 
 
 
@@ -33,53 +178,76 @@ int main(int argc, char *argv[]) {
     // among other things
     configure_terminal();
     
+    // Print statistics on exit if requested
+    configure_stats();
+    
+    // Write a memory profile on exit if requested
+    configure_profile();
+    
+    // Write a metrics file periodically if requested
+    configure_metrics();
+    
+    // Pin to a CPU and/or get real-time priority if requested
+    configure_realtime();
+    
+    // Start counting time for the limits
+    configure_limits();
+    
     // We are ready. Let's start the emulation!
 
     // Initializes hardware
     motherboard_init();
     
+    // ROM symbols for messages and tools
+    if (options.symbols){
+        symbols_load(options.symbols);
+    }
+    if (options.disassemble){
+        disasm_listing(options.disassemble);
+        exit(EXIT_SUCCESS);
+    }
+    
     // Reset all devices
     motherboard_reset();
+    
+    // Load machine code into RAM if requested
+    configure_loader();
+    
+    // Dump memory to files if requested
+    configure_dump();
+    
+    // Replace ROM routines by host code if requested
+    configure_traps();
+    configure_hypercall();
+    configure_fpu();
+    
+    // Open the second serial channel if requested
+    configure_serial();
+    
+    // Show the video RAM if requested
+    configure_video();
+    
+    // Continue from a snapshot if requested
+    if (options.resume){
+        snapshot_load(options.resume);
+    }
+    
+    // Write a checkpoint when asked to quit
+    configure_snapshot();
+    
+    // Continue a migrating computer or get ready to migrate
+    configure_migration();
    
     // Start execute instructions
 
-    // Try to get 1.000 MHz speed running 20000
-    // cycles in (less than) 20 milliseconds
-    // and then sleep up to 20 milliseconds
-    while(1){
-        struct timespec start, end, elapsed;
-        int cycles = 0;
-        
-        if (!(options.flag_turbo | options.flag_datafile)){
-            clock_gettime(CLOCK_MONOTONIC, &start);
-        }
-          
-        // Run for 20000 cycles
-        while (cycles < 20000){
-            cycles += cpu_execute();
-        }
-        
-        if (ACTION){
-            if (ACTION == ACTION_RESET){
-                printf("\n*** CPU Reset ***\n");
-                cpu_reset();
-            }
-            // Process other user actions here
-            ACTION = ACTION_NONE;
-        }
-        
-        if (!(options.flag_turbo | options.flag_datafile)){
-            clock_gettime(CLOCK_MONOTONIC, &end);
-        
-            // Calculate the time spent
-            timerspecsub(&end, &start, &elapsed);
-            long time_spent = timespec_to_ns(&elapsed);
-            
-            // 20000 cycles at 1.000 MHz is 20 ms
-            long sleeptime = 20000000L - time_spent;
-            if(sleeptime > 0){
-                nsleep(sleeptime);
-            }
-        }
-    }        
+    // Try to get 1.000 MHz speed running a slice of cycles
+    // and then waiting for the remaining of the slice time
+    if (options.flag_coroutine){
+        uk101_coroutine = coroutine_create(coroutine_loop, NULL, COROUTINE_STACK_SIZE);
+    }
+    uk101.run_slice = run_slice;
+    uk101.paced = !(options.flag_turbo | options.flag_datafile);
+    uk101.event_fd = terminal_event_fd();
+    pacer_add(&uk101);
+    pacer_run();
 }
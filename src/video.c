@@ -0,0 +1,158 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+// Video RAM of the original UK101 at VIDEO_BASE, 1 kB (16 lines)
+// or 2 kB (32 lines) of 64 characters, mirrored up to VIDEO_END.
+//
+// Writes that change a character mark its cell in a bitmap.
+// At most VIDEO_FPS times per second the changed cells are
+// drawn on the terminal, moving the cursor only when they
+// aren't next to the previous one, so a program updating a
+// few characters costs a few bytes of output and not a whole
+// screen. Characters outside printable ASCII, the graphics of
+// the UK101 character set, are drawn as spaces
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hangdetect.h"
+#include "options.h"
+#include "timeutils.h"
+#include "video.h"
+
+static uint8_t VRAM[VIDEO_MAX];
+static uint16_t mask;
+
+// Cells changed since the last frame
+static uint64_t dirty[VIDEO_MAX / 64];
+static uint8_t changed;
+
+static struct timespec last_frame;
+
+// Enough for every cell with a cursor move
+static char frame[VIDEO_MAX * 12];
+
+
+
+uint8_t video_readbyte(uint16_t address){
+    return VRAM[address & mask];
+}
+
+
+
+void video_writebyte(uint16_t address, uint8_t data){
+    uint16_t cell = address & mask;
+    if (VRAM[cell] != data){
+        VRAM[cell] = data;
+        dirty[cell >> 6] |= 1ULL << (cell & 63);
+        changed = 1;
+        // Output, even if the program repeats itself
+        hang_io();
+    }
+}
+
+
+
+// Draws the changed cells
+static void draw(void){
+    int length = 0;
+    int cursor = -1;
+    
+    for (int word = 0; word <= (mask >> 6); word++){
+        uint64_t bits = dirty[word];
+        while (bits){
+            int cell = (word << 6) | __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (cell != cursor){
+                length += sprintf(frame + length, "\033[%d;%dH", cell / VIDEO_COLUMNS + 1, cell % VIDEO_COLUMNS + 1);
+            }
+            uint8_t ch = VRAM[cell];
+            frame[length++] = ((ch >= 0x20) && (ch < 0x7F)) ? ch : ' ';
+            // Lines end at the last column, no wrapping
+            cursor = ((cell + 1) % VIDEO_COLUMNS) ? cell + 1 : -1;
+        }
+        dirty[word] = 0;
+    }
+    changed = 0;
+    fwrite(frame, 1, length, stdout);
+    fflush(stdout);
+}
+
+
+
+// Called between slices, draws a frame if it's time to
+void video_render(void){
+    struct timespec now, elapsed;
+    
+    if (!changed){
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timerspecsub(&now, &last_frame, &elapsed);
+    if (timespec_to_ns(&elapsed) < 1000000000LL / VIDEO_FPS){
+        return;
+    }
+    last_frame = now;
+    draw();
+}
+
+
+
+void video_get_state(video_state *state){
+    memcpy(state->VRAM, VRAM, sizeof(VRAM));
+}
+
+
+
+// Restores the video RAM and draws all of it again
+void video_set_state(video_state *state){
+    memcpy(VRAM, state->VRAM, sizeof(VRAM));
+    if (options.video){
+        memset(dirty, 0xFF, sizeof(dirty));
+        changed = 1;
+    }
+}
+
+
+
+static void exit_hook(void){
+    if (changed){
+        draw();
+    }
+    // Leave the cursor below the screen
+    printf("\033[%d;1H\n", (mask + 1) / VIDEO_COLUMNS);
+    fflush(stdout);
+}
+
+
+
+void configure_video(void){
+    if (!options.video){
+        return;
+    }
+    mask = options.video * 1024 - 1;
+    
+    // Start from a clear screen, drawn on the first frame
+    memset(VRAM, ' ', sizeof(VRAM));
+    memset(dirty, 0xFF, sizeof(dirty));
+    changed = 1;
+    printf("\033[2J");
+    clock_gettime(CLOCK_MONOTONIC, &last_frame);
+    atexit(exit_hook);
+}
@@ -0,0 +1,39 @@
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef video_h
+    #define video_h
+    #include <stdint.h>
+
+    // Video RAM of the original UK101, 64 bytes per line
+    #define VIDEO_BASE 0xD000
+    #define VIDEO_END 0xD7FF
+    #define VIDEO_COLUMNS 64
+    #define VIDEO_FPS 25
+    #define VIDEO_MAX 2048
+
+    // Video RAM, for snapshots
+    typedef struct{
+        uint8_t VRAM[VIDEO_MAX];
+    } video_state;
+
+    uint8_t video_readbyte(uint16_t address);
+    void video_writebyte(uint16_t address, uint8_t data);
+    void video_render(void);
+    void video_get_state(video_state *state);
+    void video_set_state(video_state *state);
+    void configure_video(void);
+#endif